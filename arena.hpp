@@ -0,0 +1,121 @@
+#pragma once
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+using namespace std;
+
+// Bump-pointer allocator. Memory is only released all at once when the
+// arena is destroyed.
+class Arena {
+  vector<unique_ptr<char[]>> blocks_;
+  char *cursor_ = nullptr;
+  char *limit_ = nullptr;
+  size_t block_size_;
+  // Size of blocks_[0], which may be larger than block_size_.
+  size_t first_block_size_ = 0;
+  size_t allocations_ = 0;
+  size_t bytes_ = 0;
+
+public:
+  explicit Arena(size_t block_size = 64 * 1024) : block_size_(block_size) {}
+
+  Arena(const Arena &) = delete;
+  Arena &operator=(const Arena &) = delete;
+
+  void *Allocate(size_t size, size_t align) {
+    auto address = reinterpret_cast<uintptr_t>(cursor_);
+    auto aligned = (address + align - 1) & ~(uintptr_t(align) - 1);
+    if (!cursor_ || aligned + size > reinterpret_cast<uintptr_t>(limit_)) {
+      auto block_size = max(block_size_, size + align);
+      blocks_.emplace_back(new char[block_size]);
+      if (blocks_.size() == 1) {
+        first_block_size_ = block_size;
+      }
+      cursor_ = blocks_.back().get();
+      limit_ = cursor_ + block_size;
+      address = reinterpret_cast<uintptr_t>(cursor_);
+      aligned = (address + align - 1) & ~(uintptr_t(align) - 1);
+    }
+    cursor_ = reinterpret_cast<char *>(aligned + size);
+    allocations_++;
+    bytes_ += size;
+    return reinterpret_cast<void *>(aligned);
+  }
+
+  // Frees every block but the first and hands that one out again. Only
+  // valid once nothing allocated from the arena is alive.
+  void Reset() {
+    if (blocks_.empty()) {
+      return;
+    }
+    blocks_.resize(1);
+    cursor_ = blocks_[0].get();
+    limit_ = cursor_ + first_block_size_;
+    allocations_ = 0;
+    bytes_ = 0;
+  }
+
+  size_t allocations() const { return allocations_; }
+  size_t bytes() const { return bytes_; }
+  size_t block_count() const { return blocks_.size(); }
+};
+
+// Makes arena the one NodeList spills long child lists into on this
+// thread for as long as the scope lives, nullptr meaning the heap. The
+// parser installs its arena while building a tree in arena mode, and none
+// while user code runs. Scopes nest.
+class ArenaScope {
+  static inline thread_local Arena *current_ = nullptr;
+  Arena *previous_;
+
+public:
+  explicit ArenaScope(Arena *arena) : previous_(current_) { current_ = arena; }
+  ~ArenaScope() { current_ = previous_; }
+
+  ArenaScope(const ArenaScope &) = delete;
+  ArenaScope &operator=(const ArenaScope &) = delete;
+
+  static Arena *current() { return current_; }
+};
+
+// Standard allocator over an Arena. Every copy shares ownership of the
+// arena, so memory handed out stays valid for as long as anything
+// allocated from it is alive.
+//
+// The parser gives it to allocate_shared, so every node's control block
+// holds a copy. That costs an atomic reference count per node, and
+// freeing a tree still runs each node's destructor, so teardown is
+// O(nodes) like a heap tree; only the per-node free is saved. A single
+// owner releasing the blocks wholesale would not be safe here: nodes own
+// strings and spilled child lists that need their destructors, and any
+// subtree may outlive its program (statements from ParseStreaming,
+// handles held from JS, statements Reparse shares with a newer tree),
+// each of which must keep the arena alive on its own.
+template <typename T> class ArenaAllocator {
+  template <typename U> friend class ArenaAllocator;
+  shared_ptr<Arena> arena_;
+
+public:
+  using value_type = T;
+
+  ArenaAllocator(shared_ptr<Arena> arena) : arena_(move(arena)) {}
+
+  template <typename U>
+  ArenaAllocator(const ArenaAllocator<U> &other) : arena_(other.arena_) {}
+
+  T *allocate(size_t n) {
+    return static_cast<T *>(arena_->Allocate(n * sizeof(T), alignof(T)));
+  }
+
+  void deallocate(T *, size_t) {}
+
+  template <typename U> bool operator==(const ArenaAllocator<U> &rhs) const {
+    return arena_ == rhs.arena_;
+  }
+
+  template <typename U> bool operator!=(const ArenaAllocator<U> &rhs) const {
+    return arena_ != rhs.arena_;
+  }
+};
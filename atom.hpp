@@ -0,0 +1,127 @@
+#pragma once
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+using namespace std;
+
+using Atom = uint32_t;
+
+// Interns identifier text, so comparing names from one table is comparing
+// integers. Atoms of different tables are unrelated.
+//
+// A table is scoped to a parse: each Parser interns into its own, and the
+// ProgramNode of the tree holds it. An IdentifierNode holds its atom and a
+// plain pointer to the table, so a subtree kept without its ProgramNode
+// must keep the table alive too, see Parser::atoms(). Reset starts a
+// fresh table unless no tree holds the old one, in which case it is
+// cleared and reused.
+//
+// Intern is not locked. Threads interning into one table each go through
+// an AtomCache, or call InternShared, on intern_mutex(). name() may run
+// while another thread interns, since names never move once added.
+class AtomTable {
+  // Chunk k holds 32 << k names, so 27 chunks cover every atom.
+  static constexpr size_t kFirstChunkSize = 32;
+  static constexpr size_t kChunkCount = 27;
+
+  // Set once each and never moved, which is what makes name() safe to call
+  // while another thread interns.
+  array<atomic<string *>, kChunkCount> chunks_{};
+  size_t size_ = 0;
+  unordered_map<string_view, Atom> atoms_;
+  mutex intern_mutex_;
+
+  // Chunk holding atom and its index there.
+  static pair<size_t, size_t> Locate(Atom atom) {
+    auto biased = static_cast<uint64_t>(atom) / kFirstChunkSize + 1;
+    size_t chunk = 63 - __builtin_clzll(biased);
+    auto first = kFirstChunkSize * ((uint64_t(1) << chunk) - 1);
+    return {chunk, static_cast<size_t>(atom - first)};
+  }
+
+public:
+  AtomTable() = default;
+  AtomTable(const AtomTable &) = delete;
+  AtomTable &operator=(const AtomTable &) = delete;
+  ~AtomTable() { Clear(); }
+
+  Atom Intern(string_view name) {
+    auto iter = atoms_.find(name);
+    if (iter != atoms_.end()) {
+      return iter->second;
+    }
+    auto atom = static_cast<Atom>(size_);
+    auto [chunk, index] = Locate(atom);
+    auto names = chunks_[chunk].load(memory_order_relaxed);
+    if (!names) {
+      names = new string[kFirstChunkSize << chunk];
+      chunks_[chunk].store(names, memory_order_release);
+    }
+    names[index] = name;
+    size_++;
+    atoms_.emplace(names[index], atom);
+    return atom;
+  }
+
+  const string &name(Atom atom) const {
+    auto [chunk, index] = Locate(atom);
+    return chunks_[chunk].load(memory_order_acquire)[index];
+  }
+
+  size_t size() const { return size_; }
+
+  // Takes no lock, the table must not be shared with another thread.
+  void Clear() {
+    atoms_.clear();
+    for (auto &chunk : chunks_) {
+      delete[] chunk.exchange(nullptr, memory_order_relaxed);
+    }
+    size_ = 0;
+  }
+
+  // Serializes threads interning through AtomCaches over this table.
+  mutex &intern_mutex() { return intern_mutex_; }
+
+  // Intern for a table other threads may be interning into.
+  Atom InternShared(string_view name) {
+    lock_guard<mutex> lock(intern_mutex_);
+    return Intern(name);
+  }
+
+  // Table of identifiers built by hand, or decoded without a program. It
+  // is shared by every thread and never freed.
+  static AtomTable &Global() {
+    static auto *table = new AtomTable;
+    return *table;
+  }
+};
+
+// Front of an AtomTable that several threads intern into. A name this
+// cache has seen is found without locking, only the first sight of a name
+// takes mutex, so threads parsing similar code rarely contend.
+class AtomCache {
+  AtomTable &table_;
+  mutex &mutex_;
+  // Keys point into the table, whose names never move.
+  unordered_map<string_view, Atom> atoms_;
+
+public:
+  AtomCache(AtomTable &table, mutex &mutex) : table_(table), mutex_(mutex) {}
+
+  Atom Intern(string_view name) {
+    auto iter = atoms_.find(name);
+    if (iter != atoms_.end()) {
+      return iter->second;
+    }
+    lock_guard<mutex> lock(mutex_);
+    auto atom = table_.Intern(name);
+    atoms_.emplace(table_.name(atom), atom);
+    return atom;
+  }
+};
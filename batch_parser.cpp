@@ -0,0 +1,113 @@
+#include "batch_parser.hpp"
+#include "parser_pool.hpp"
+#include <atomic>
+#include <fstream>
+
+namespace {
+
+bool ReadFile(const string &path, string &contents) {
+  ifstream in(path, ios::binary);
+  if (!in) {
+    return false;
+  }
+  in.seekg(0, ios::end);
+  auto size = in.tellg();
+  if (size < 0) {
+    return false;
+  }
+  contents.resize(static_cast<size_t>(size));
+  in.seekg(0);
+  in.read(contents.data(), contents.size());
+  return static_cast<bool>(in);
+}
+
+} // namespace
+
+struct BatchParser::Batch {
+  vector<string> inputs;
+  // inputs are paths rather than sources.
+  bool paths;
+  ParserOptions options;
+  function<void(ParseResult)> done;
+  atomic<size_t> next{0};
+};
+
+BatchParser::BatchParser(size_t threads, ParserOptions options)
+    : options_(options), pool_(threads) {
+  options_.parse_threads = 0;
+  options_.lex_threads = 0;
+}
+
+// Runs one worker per thread, each taking inputs until none are left.
+vector<future<void>> BatchParser::Start(vector<string> inputs, bool paths,
+                                        function<void(ParseResult)> done) {
+  auto batch = make_shared<Batch>();
+  batch->inputs = move(inputs);
+  batch->paths = paths;
+  batch->options = options_;
+  batch->done = move(done);
+  vector<future<void>> workers;
+  auto count = min(max<size_t>(pool_.size(), 1), batch->inputs.size());
+  for (size_t i = 0; i < count; i++) {
+    workers.push_back(pool_.Submit([batch] {
+      for (size_t index; (index = batch->next++) < batch->inputs.size();) {
+        ParseResult result{index, {}, nullptr, {}};
+        auto &input = batch->inputs[index];
+        string source;
+        if (batch->paths) {
+          result.path = input;
+          if (!ReadFile(input, source)) {
+            batch->done(move(result));
+            continue;
+          }
+        } else {
+          source = move(input);
+        }
+        PooledParser parser(move(source), batch->options);
+        result.program = parser->Parse();
+        result.diagnostics = parser->diagnostics();
+        batch->done(move(result));
+      }
+    }));
+  }
+  return workers;
+}
+
+vector<future<ParseResult>> BatchParser::Submit(vector<string> inputs,
+                                                bool paths) {
+  auto promises = make_shared<vector<promise<ParseResult>>>(inputs.size());
+  vector<future<ParseResult>> futures;
+  futures.reserve(promises->size());
+  for (auto &promise : *promises) {
+    futures.push_back(promise.get_future());
+  }
+  Start(move(inputs), paths, [promises](ParseResult result) {
+    (*promises)[result.index].set_value(move(result));
+  });
+  return futures;
+}
+
+void BatchParser::Run(vector<string> inputs, bool paths,
+                      function<void(ParseResult)> done) {
+  for (auto &worker : Start(move(inputs), paths, move(done))) {
+    worker.get();
+  }
+}
+
+vector<future<ParseResult>> BatchParser::ParseMany(vector<string> sources) {
+  return Submit(move(sources), false);
+}
+
+vector<future<ParseResult>> BatchParser::ParseFiles(vector<string> paths) {
+  return Submit(move(paths), true);
+}
+
+void BatchParser::ParseMany(vector<string> sources,
+                            const function<void(ParseResult)> &done) {
+  Run(move(sources), false, done);
+}
+
+void BatchParser::ParseFiles(vector<string> paths,
+                             const function<void(ParseResult)> &done) {
+  Run(move(paths), true, done);
+}
@@ -0,0 +1,59 @@
+#pragma once
+#include "parser.hpp"
+#include "thread_pool.hpp"
+#include <functional>
+#include <future>
+#include <string>
+#include <vector>
+using namespace std;
+
+// Tree and syntax errors of one input of a batch.
+struct ParseResult {
+  // Position of the input in the batch.
+  size_t index;
+  // Empty for sources passed in memory.
+  string path;
+  // nullptr if path could not be read.
+  SN program;
+  vector<Diagnostic> diagnostics;
+};
+
+// Parses many files on a fixed pool of threads, one file per thread at a
+// time, each thread reusing its parser through PooledParser. Workers pull
+// the next input from a shared counter instead of queueing a task per
+// file, so tiny files do not contend on the pool's queue, and throughput
+// grows with the thread count until reading the files is the bottleneck.
+//
+// Each file is parsed with the options the batch was created with, except
+// that parse_threads and lex_threads are ignored: the batch already keeps
+// every thread busy. With lazy_functions, bodies are parsed by whichever
+// thread first calls body().
+class BatchParser {
+  ParserOptions options_;
+  ThreadPool pool_;
+
+  struct Batch;
+  vector<future<void>> Start(vector<string> inputs, bool paths,
+                             function<void(ParseResult)> done);
+  vector<future<ParseResult>> Submit(vector<string> inputs, bool paths);
+  void Run(vector<string> inputs, bool paths,
+           function<void(ParseResult)> done);
+
+public:
+  explicit BatchParser(size_t threads = thread::hardware_concurrency(),
+                       ParserOptions options = ParserOptions());
+
+  // Results in input order, each ready once its input is parsed.
+  vector<future<ParseResult>> ParseMany(vector<string> sources);
+  vector<future<ParseResult>> ParseFiles(vector<string> paths);
+
+  // Calls done on a worker thread as each input is parsed, in no
+  // particular order, and returns once all of them are. done may be called
+  // from several threads at once.
+  void ParseMany(vector<string> sources,
+                 const function<void(ParseResult)> &done);
+  void ParseFiles(vector<string> paths,
+                  const function<void(ParseResult)> &done);
+
+  size_t threads() const { return pool_.size(); }
+};
@@ -0,0 +1,259 @@
+#include "batch_parser.hpp"
+#include "parallel_lexer.hpp"
+#include "parser.hpp"
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <new>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Heap allocations so far, to compare the default and arena modes.
+atomic<size_t> heap_allocations{0};
+
+void *operator new(size_t size) {
+  heap_allocations.fetch_add(1, memory_order_relaxed);
+  if (auto memory = malloc(size ? size : 1)) {
+    return memory;
+  }
+  throw bad_alloc();
+}
+
+void operator delete(void *memory) noexcept { free(memory); }
+void operator delete(void *memory, size_t) noexcept { free(memory); }
+
+// Parses machine-generated inputs that nest or chain without bound and
+// reports the time per parse, including freeing the tree, and the heap
+// allocations it made. Not part of the
+// WASM build, build it with one command such as:
+//
+//   g++ -std=c++17 -O2 -I. bench.cpp parser.cpp lexer.cpp scanner.cpp
+//     parallel_lexer.cpp parallel_parser.cpp incremental.cpp serializer.cpp
+//     parse_cache.cpp batch_parser.cpp dependency_scan.cpp scope.cpp
+//     visitor.cpp -lfmt -lpthread -o bench && ./bench 100000
+//
+// that is every source of the yajp target but main.cpp.
+//
+// None of the inputs may overflow the stack, whatever the depth, so it is
+// also worth running under a small stack limit such as `ulimit -s 256`.
+
+namespace {
+
+string Repeat(const string &text, size_t count) {
+  string result;
+  result.reserve(text.size() * count);
+  for (size_t i = 0; i < count; i++) {
+    result += text;
+  }
+  return result;
+}
+
+void Run(const char *name, const string &source,
+         ParserOptions options = ParserOptions()) {
+  const int kRounds = 5;
+  double best = 0;
+  size_t errors = 0;
+  size_t allocations = 0;
+  for (int round = 0; round < kRounds; round++) {
+    auto begin = chrono::steady_clock::now();
+    auto before = heap_allocations.load();
+    {
+      Parser parser(source, options);
+      auto program = parser.Parse();
+      errors = parser.diagnostics().size();
+    }
+    allocations = heap_allocations.load() - before;
+    chrono::duration<double, milli> elapsed =
+        chrono::steady_clock::now() - begin;
+    if (round == 0 || elapsed.count() < best) {
+      best = elapsed.count();
+    }
+  }
+  printf("%-24s %10zu bytes %10.2f ms %8.1f MB/s %9zu allocs%s\n", name,
+         source.size(), best, source.size() / best / 1e3, allocations,
+         errors > 0 ? "  (errors)" : "");
+}
+
+// Times lexing alone, which is where keyword lookup is paid: with
+// Lexer::Tokenize, or with ParallelTokenize on threads threads.
+void Lex(const char *name, const string &source, size_t threads = 0) {
+  const int kRounds = 5;
+  double best = 0;
+  size_t tokens = 0;
+  unique_ptr<ThreadPool> pool;
+  if (threads > 0) {
+    pool = make_unique<ThreadPool>(threads);
+  }
+  for (int round = 0; round < kRounds; round++) {
+    Lexer lexer(source);
+    auto begin = chrono::steady_clock::now();
+    if (pool) {
+      tokens = ParallelTokenize(source, *pool).size();
+    } else {
+      lexer.Tokenize();
+      tokens = lexer.tokens().size();
+    }
+    chrono::duration<double, milli> elapsed =
+        chrono::steady_clock::now() - begin;
+    if (round == 0 || elapsed.count() < best) {
+      best = elapsed.count();
+    }
+  }
+  printf("%-24s %10zu bytes %10.2f ms %8.1f MB/s %9zu tokens\n", name,
+         source.size(), best, source.size() / best / 1e3, tokens);
+}
+
+// Sum of the values Numbers converted, so the conversions are not
+// optimized away.
+volatile double number_sink;
+
+// Lexes source and converts every numeric token, with ParseNumber on the
+// source slice as ParseNumericLiteral does, or with strtod on a copy of
+// the token as it did before.
+void Numbers(const char *name, const string &source, bool use_strtod) {
+  const int kRounds = 5;
+  double best = 0;
+  size_t numbers = 0;
+  for (int round = 0; round < kRounds; round++) {
+    Lexer lexer(source);
+    double sum = 0;
+    numbers = 0;
+    auto begin = chrono::steady_clock::now();
+    for (auto token = lexer.GetToken(); token != TokenType::kEofToken;
+         token = lexer.GetToken()) {
+      if (token == TokenType::kNumericToken) {
+        sum += use_strtod ? strtod(lexer.value().c_str(), nullptr)
+                          : ParseNumber(lexer.view()).value;
+        numbers++;
+      }
+    }
+    chrono::duration<double, milli> elapsed =
+        chrono::steady_clock::now() - begin;
+    if (round == 0 || elapsed.count() < best) {
+      best = elapsed.count();
+    }
+    number_sink = sum;
+  }
+  printf("%-24s %10zu bytes %10.2f ms %8.1f MB/s %9zu numbers\n", name,
+         source.size(), best, source.size() / best / 1e3, numbers);
+}
+
+// Times BatchParser::ParseMany over sources on threads threads, trees
+// freed as they arrive, and reports files per second.
+void Batch(const char *name, const vector<string> &sources, size_t threads) {
+  const int kRounds = 5;
+  double best = 0;
+  atomic<size_t> errors{0};
+  BatchParser batch(threads);
+  for (int round = 0; round < kRounds; round++) {
+    auto inputs = sources;
+    errors = 0;
+    auto begin = chrono::steady_clock::now();
+    batch.ParseMany(move(inputs), [&](ParseResult result) {
+      errors += result.diagnostics.size();
+    });
+    chrono::duration<double, milli> elapsed =
+        chrono::steady_clock::now() - begin;
+    if (round == 0 || elapsed.count() < best) {
+      best = elapsed.count();
+    }
+  }
+  printf("%-24s %10zu files %10.2f ms %8.0f files/s%s\n", name,
+         sources.size(), best, sources.size() / best * 1e3,
+         errors > 0 ? "  (errors)" : "");
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  size_t depth = argc > 1 ? stoul(argv[1]) : 100000;
+
+  Run("a + b + ...", "a" + Repeat(" + a", depth) + ";");
+  Run("a ** b ** ...", "a" + Repeat(" ** a", depth) + ";");
+  Run("mixed precedence",
+      "a" + Repeat(" * a + a << a - a && a", depth / 5) + ";");
+  Run("((( a )))", Repeat("(", depth) + "a" + Repeat(")", depth) + ";");
+  Run("(a + (a + (...)))",
+      Repeat("(a + ", depth) + "a" + Repeat(")", depth) + ";");
+  Run("- - - a", Repeat("- ", depth) + "a;");
+  Run("{ { { } } }", Repeat("{ ", depth) + Repeat("} ", depth));
+  Run("{ a; { a; { ... } } }",
+      Repeat("{ a + a; ", depth) + Repeat("} ", depth));
+  Run("f(a); ...", Repeat("f(a, b) + g(c);\n", depth));
+  Run("numeric literals",
+      Repeat("let a = 12345 + 0x1f_ff + 1.5e3 + 0b1010 + 0o17 + 999999n;\n",
+             depth / 5));
+
+  // A JSON-like array of numbers, lexed with each token converted the
+  // current way and the old one. Arrays do not parse yet, so it is lexed.
+  auto array = "[" +
+               Repeat("12345, 0.5, 3.14159, 6.02e23, 42, 1e-7, 987654321, ",
+                      depth) +
+               "0]";
+  Numbers("numbers, ParseNumber", array, false);
+  Numbers("numbers, strtod", array, true);
+
+  // Identifiers that share a length and first letter with a keyword, then
+  // keywords, each at two sizes to show lexing stays linear.
+  auto identifiers = "let ret = iff + returns + thiss + voids + ina + dos;\n";
+  auto keywords = "if else return this void in do typeof new delete case;\n";
+  Lex("identifiers", Repeat(identifiers, depth / 10));
+  Lex("identifiers x10", Repeat(identifiers, depth));
+  Lex("keywords", Repeat(keywords, depth / 10));
+  Lex("keywords x10", Repeat(keywords, depth));
+
+  // A bundle-sized input lexed in place, then on growing thread counts.
+  auto bundle = Repeat("function f(a, b) { return g(a, 'x', \"y\") + b; }"
+                       " /* comment */ // line\n",
+                       depth * 5);
+  Lex("bundle", bundle);
+  for (size_t threads : {1, 2, 4, 8}) {
+    auto name = "bundle, " + to_string(threads) + " threads";
+    Lex(name.c_str(), bundle, threads);
+  }
+
+  // A bundle of code that parses cleanly, whole, then split across
+  // growing thread counts.
+  auto parsed_bundle =
+      Repeat("function f(a, b) { let c = a + b; { g(c); } return c; }"
+             " /* comment */ // line\n",
+             depth);
+  Run("parse bundle", parsed_bundle);
+  for (size_t threads : {1, 2, 4, 8}) {
+    ParserOptions options;
+    options.parse_threads = threads;
+    auto name = "parse bundle, " + to_string(threads) + " threads";
+    Run(name.c_str(), parsed_bundle, options);
+  }
+
+  // Many small modules through one batch, on 1 thread up to at least 8
+  // and the hardware's count.
+  vector<string> modules;
+  for (size_t i = 0; i < depth / 10; i++) {
+    auto n = to_string(i);
+    modules.push_back("import a" + n + " from './m" + n + "';\n"
+                      "export function f" + n + "(b) { let c = a" + n +
+                      " + b; return c; }\n");
+  }
+  size_t max_threads = max<size_t>(8, thread::hardware_concurrency());
+  for (size_t threads = 1; threads <= max_threads;
+       threads = threads < max_threads ? min(threads * 2, max_threads)
+                                       : threads + 1) {
+    auto name = "modules, " + to_string(threads) + " threads";
+    Batch(name.c_str(), modules, threads);
+  }
+
+  // The same code with nodes and long child lists from the heap, then
+  // from an arena. Allocation counts include freeing the tree.
+  auto code = Repeat("function f(a, b, c, d, e) { let x = a + b, y = -c;"
+                     " { g(a, b, c, d, e, x); } return a + b * y; }\n",
+                     depth / 10);
+  Run("heap nodes", code);
+  ParserOptions arena;
+  arena.arena = true;
+  Run("arena nodes", code, arena);
+  return 0;
+}
@@ -0,0 +1,331 @@
+#include "dependency_scan.hpp"
+#include "lexer.hpp"
+
+namespace {
+
+class DependencyScanner {
+  Lexer lexer_;
+  vector<DependencyRecord> records_;
+  // End offset of the last consumed token.
+  size_t end_ = 0;
+
+  TokenType token() { return lexer_.current_token(); }
+
+  void Next() {
+    end_ = lexer_.offset();
+    lexer_.GetToken();
+  }
+
+  bool Accept(TokenType token) {
+    if (lexer_.current_token() != token) {
+      return false;
+    }
+    Next();
+    return true;
+  }
+
+  // Identifiers and keywords, which are allowed as specifier names.
+  bool AtName() {
+    auto text = lexer_.view();
+    return token() != TokenType::kStringToken &&
+           token() != TokenType::kEofToken && !text.empty() &&
+           kCharClasses[static_cast<unsigned char>(text[0])] ==
+               CharClass::kIdentifier;
+  }
+
+  bool TakeName(string &name) {
+    if (!AtName()) {
+      return false;
+    }
+    name = lexer_.view();
+    Next();
+    return true;
+  }
+
+  bool TakeSource(string &source) {
+    if (token() != TokenType::kStringToken) {
+      return false;
+    }
+    source = lexer_.view();
+    Next();
+    return true;
+  }
+
+  void Finish(DependencyRecord record) {
+    Accept(TokenType::kSemiColonToken);
+    record.end = static_cast<uint32_t>(end_);
+    records_.push_back(move(record));
+  }
+
+  // Skips to the first `,` or `;` outside brackets, a bracket closing one
+  // opened before, or an `import` or `export` outside brackets.
+  void SkipExpression() {
+    size_t depth = 0;
+    while (token() != TokenType::kEofToken) {
+      switch (token()) {
+      case TokenType::kLeftParenToken:
+      case TokenType::kLeftBracketToken:
+      case TokenType::kLeftBraceToken:
+        depth++;
+        break;
+      case TokenType::kRightParenToken:
+      case TokenType::kRightBracketToken:
+      case TokenType::kRightBraceToken:
+        if (depth == 0) {
+          return;
+        }
+        depth--;
+        break;
+      case TokenType::kCommaToken:
+      case TokenType::kSemiColonToken:
+      case TokenType::kImportToken:
+      case TokenType::kExportToken:
+        if (depth == 0) {
+          return;
+        }
+        break;
+      default:
+        break;
+      }
+      Next();
+    }
+  }
+
+  // With the current token on an opening bracket, moves past its match.
+  bool SkipBrackets() {
+    size_t depth = 0;
+    do {
+      switch (token()) {
+      case TokenType::kLeftParenToken:
+      case TokenType::kLeftBracketToken:
+      case TokenType::kLeftBraceToken:
+        depth++;
+        break;
+      case TokenType::kRightParenToken:
+      case TokenType::kRightBracketToken:
+      case TokenType::kRightBraceToken:
+        depth--;
+        break;
+      case TokenType::kEofToken:
+        return false;
+      default:
+        break;
+      }
+      Next();
+    } while (depth > 0);
+    return true;
+  }
+
+  // With the current token on the first token after `{`, takes
+  // `name [as name], ...}` into specifiers as (first, second) for imports
+  // or (second, first) for exports.
+  bool TakeSpecifierList(bool import, vector<DependencySpecifier> &specifiers) {
+    while (!Accept(TokenType::kRightBraceToken)) {
+      string first;
+      if (!TakeName(first)) {
+        return false;
+      }
+      auto second = first;
+      if (Accept(TokenType::kAsToken) && !TakeName(second)) {
+        return false;
+      }
+      if (import) {
+        specifiers.push_back({move(first), move(second)});
+      } else {
+        specifiers.push_back({move(second), move(first)});
+      }
+      if (!Accept(TokenType::kCommaToken) &&
+          token() != TokenType::kRightBraceToken) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  bool ScanImport(DependencyRecord &record) {
+    record.kind = DependencyKind::kImport;
+    Next();
+    if (TakeSource(record.source)) {
+      return true;
+    }
+    string local;
+    if (TakeName(local)) {
+      record.specifiers.push_back({"default", move(local)});
+      if (!Accept(TokenType::kCommaToken)) {
+        return Accept(TokenType::kFromToken) && TakeSource(record.source);
+      }
+    }
+    if (Accept(TokenType::kMulToken)) {
+      if (!Accept(TokenType::kAsToken) || !TakeName(local)) {
+        return false;
+      }
+      record.specifiers.push_back({"*", move(local)});
+    } else if (!Accept(TokenType::kLeftBraceToken) ||
+               !TakeSpecifierList(true, record.specifiers)) {
+      return false;
+    }
+    return Accept(TokenType::kFromToken) && TakeSource(record.source);
+  }
+
+  // A function or class declaration, with the current token on `function`
+  // or `class`. The name, if any, goes to name.
+  bool SkipFunctionOrClass(string &name) {
+    bool function = token() == TokenType::kFunctionToken;
+    Next();
+    Accept(TokenType::kMulToken);
+    if (token() != TokenType::kLeftParenToken &&
+        token() != TokenType::kLeftBraceToken &&
+        token() != TokenType::kExtendsToken) {
+      TakeName(name);
+    }
+    if (function) {
+      if (token() != TokenType::kLeftParenToken || !SkipBrackets()) {
+        return false;
+      }
+    } else if (Accept(TokenType::kExtendsToken)) {
+      while (token() != TokenType::kLeftBraceToken &&
+             token() != TokenType::kEofToken) {
+        Next();
+      }
+    }
+    if (token() != TokenType::kLeftBraceToken) {
+      return false;
+    }
+    end_ = lexer_.SkipBraces();
+    return true;
+  }
+
+  bool ScanVariableDeclaration(vector<DependencySpecifier> &specifiers) {
+    Next();
+    do {
+      string name;
+      if (!TakeName(name)) {
+        return false;
+      }
+      specifiers.push_back({name, name});
+      if (Accept(TokenType::kEqualToken)) {
+        SkipExpression();
+      }
+    } while (Accept(TokenType::kCommaToken));
+    return true;
+  }
+
+  bool ScanExport(DependencyRecord &record) {
+    Next();
+    if (Accept(TokenType::kDefaultToken)) {
+      record.kind = DependencyKind::kExportDefault;
+      string local;
+      if (token() == TokenType::kAsyncToken &&
+          lexer_.PeekToken() == TokenType::kFunctionToken) {
+        Next();
+      }
+      if (token() == TokenType::kFunctionToken ||
+          token() == TokenType::kClassToken) {
+        if (!SkipFunctionOrClass(local)) {
+          return false;
+        }
+      } else {
+        SkipExpression();
+      }
+      record.specifiers.push_back({"default", move(local)});
+      return true;
+    }
+    record.kind = DependencyKind::kExportNamed;
+    if (Accept(TokenType::kMulToken)) {
+      if (Accept(TokenType::kAsToken)) {
+        string name;
+        if (!TakeName(name)) {
+          return false;
+        }
+        record.specifiers.push_back({move(name), "*"});
+      } else {
+        record.kind = DependencyKind::kExportAll;
+      }
+      return Accept(TokenType::kFromToken) && TakeSource(record.source);
+    }
+    if (Accept(TokenType::kLeftBraceToken)) {
+      if (!TakeSpecifierList(false, record.specifiers)) {
+        return false;
+      }
+      return !Accept(TokenType::kFromToken) || TakeSource(record.source);
+    }
+    switch (token()) {
+    case TokenType::kAsyncToken:
+      Next();
+      if (token() != TokenType::kFunctionToken) {
+        return false;
+      }
+      [[fallthrough]];
+    case TokenType::kFunctionToken:
+    case TokenType::kClassToken: {
+      string name;
+      if (!SkipFunctionOrClass(name) || name.empty()) {
+        return false;
+      }
+      record.specifiers.push_back({name, name});
+      return true;
+    }
+    case TokenType::kVarToken:
+    case TokenType::kLetToken:
+    case TokenType::kConstToken:
+      return ScanVariableDeclaration(record.specifiers);
+    default:
+      return false;
+    }
+  }
+
+public:
+  DependencyScanner(string_view source)
+      : lexer_(source.data(), source.data() + source.size()) {}
+
+  vector<DependencyRecord> Scan() {
+    lexer_.GetToken();
+    size_t depth = 0;
+    auto previous = TokenType::kSemiColonToken;
+    while (token() != TokenType::kEofToken) {
+      auto current = token();
+      bool member = previous == TokenType::kDotToken ||
+                    previous == TokenType::kQuestionDotToken;
+      previous = current;
+      if (depth == 0 && !member &&
+          (current == TokenType::kExportToken ||
+           (current == TokenType::kImportToken &&
+            lexer_.PeekToken() != TokenType::kLeftParenToken &&
+            lexer_.PeekToken() != TokenType::kDotToken))) {
+        DependencyRecord record{};
+        record.start = static_cast<uint32_t>(lexer_.token_start());
+        bool scanned = current == TokenType::kImportToken
+                           ? ScanImport(record)
+                           : ScanExport(record);
+        if (scanned) {
+          Finish(move(record));
+        }
+        continue;
+      }
+      switch (current) {
+      case TokenType::kLeftParenToken:
+      case TokenType::kLeftBracketToken:
+      case TokenType::kLeftBraceToken:
+        depth++;
+        break;
+      case TokenType::kRightParenToken:
+      case TokenType::kRightBracketToken:
+      case TokenType::kRightBraceToken:
+        if (depth > 0) {
+          depth--;
+        }
+        break;
+      default:
+        break;
+      }
+      Next();
+    }
+    return move(records_);
+  }
+};
+
+} // namespace
+
+vector<DependencyRecord> ScanDependencies(string_view source) {
+  return DependencyScanner(source).Scan();
+}
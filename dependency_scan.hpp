@@ -0,0 +1,48 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+using namespace std;
+
+enum class DependencyKind : uint8_t {
+  kImport,
+  kExportNamed,
+  kExportAll,
+  kExportDefault,
+};
+
+struct DependencySpecifier {
+  // Name on the far side of the module boundary: the imported name of an
+  // import, the exported name of an export. "default" and "*" for default
+  // and namespace imports.
+  string name;
+  // Name on this side: the binding an import creates, the binding an
+  // export refers to, or for a re-export the name in source, "*" for
+  // `export * as ns`. Empty for an `export default` expression.
+  string local;
+};
+
+// One import or export declaration.
+struct DependencyRecord {
+  DependencyKind kind;
+  // Module specifier without quotes, empty for exports without `from`.
+  string source;
+  vector<DependencySpecifier> specifiers;
+  // From the `import` or `export` keyword to just past the declaration,
+  // including its `;`.
+  uint32_t start;
+  uint32_t end;
+};
+
+// Finds the import and export declarations of a module without building
+// a tree. Everything else is skipped token by token, only tracking
+// bracket depth, so import and export keywords are recognized only
+// outside brackets and not after a `.`. Dynamic `import(...)` and
+// `import.meta` are not declarations and are skipped.
+//
+// Accepts what Parser accepts and more: `export class` and keywords as
+// specifier names. A declaration it cannot make sense of is dropped and
+// scanning goes on after it, so malformed sources yield the records that
+// are well formed.
+vector<DependencyRecord> ScanDependencies(string_view source);
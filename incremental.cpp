@@ -0,0 +1,387 @@
+#include "parser.hpp"
+
+namespace {
+
+// End of the token starting at offset.
+size_t TokenEnd(string_view source, size_t offset) {
+  Lexer lexer(source.data(), source.data() + source.size());
+  lexer.Seek(offset);
+  lexer.GetToken();
+  return lexer.offset();
+}
+
+// Copy of statement, every node in it moved delta bytes. Unparsed lazy
+// bodies stay unparsed, over lexer's source at their new place. The copy
+// shares nothing with statement, whose lazy bodies must not be parsed
+// meanwhile.
+SN Rebased(const SN &statement, int64_t delta,
+           const shared_ptr<Lexer> &lexer) {
+  // Spilled child lists go to the heap like the copied nodes.
+  ArenaScope heap(nullptr);
+  vector<Node *> pending;
+  auto copy = [&](const SN &node) -> SN {
+    if (!node) {
+      return nullptr;
+    }
+    auto copied = node->Clone();
+    copied->set_start(static_cast<uint32_t>(node->start() + delta));
+    pending.push_back(copied.get());
+    return copied;
+  };
+  auto copy_list = [&](const NodeList &list) {
+    NodeList copied;
+    for (const auto &node : list) {
+      copied.push_back(copy(node));
+    }
+    return copied;
+  };
+  auto copy_function = [&](auto &function) {
+    function.set_id(copy(function.id()));
+    function.set_params(copy_list(function.params()));
+    if (function.body_parsed()) {
+      function.set_body(copy(function.body()));
+      return;
+    }
+    auto lazy = make_shared<LazyFunctionBody>(*function.lazy_body());
+    lazy->lexer = lexer;
+    lazy->start = static_cast<uint32_t>(lazy->start + delta);
+    lazy->end = static_cast<uint32_t>(lazy->end + delta);
+    function.set_lazy_body(move(lazy));
+  };
+
+  auto root = copy(statement);
+  while (!pending.empty()) {
+    auto *node = pending.back();
+    pending.pop_back();
+    switch (node->type()) {
+    case NodeType::kUnaryExpression: {
+      auto &unary = static_cast<UnaryExpressionNode &>(*node);
+      unary.set_argument(copy(unary.argument()));
+      break;
+    }
+    case NodeType::kBinaryExpression: {
+      auto &binary = static_cast<BinaryExpressionNode &>(*node);
+      binary.set_left(copy(binary.left()));
+      binary.set_right(copy(binary.right()));
+      break;
+    }
+    case NodeType::kExpressionStatement: {
+      auto &expression = static_cast<ExpressionStatementNode &>(*node);
+      expression.set_expression(copy(expression.expression()));
+      break;
+    }
+    case NodeType::kBlockStatement: {
+      auto &block = static_cast<BlockStatementNode &>(*node);
+      block.set_body(copy_list(block.body()));
+      break;
+    }
+    case NodeType::kReturnStatement: {
+      auto &statement = static_cast<ReturnStatementNode &>(*node);
+      statement.set_argument(copy(statement.argument()));
+      break;
+    }
+    case NodeType::kIfStatement: {
+      auto &statement = static_cast<IfStatementNode &>(*node);
+      statement.set_test(copy(statement.test()));
+      statement.set_consequent(copy(statement.consequent()));
+      statement.set_alternate(copy(statement.alternate()));
+      break;
+    }
+    case NodeType::kSwitchStatement: {
+      auto &statement = static_cast<SwitchStatementNode &>(*node);
+      statement.set_discriminant(copy(statement.discriminant()));
+      statement.set_cases(copy_list(statement.cases()));
+      break;
+    }
+    case NodeType::kSwitchCase: {
+      auto &clause = static_cast<SwitchCaseNode &>(*node);
+      clause.set_test(copy(clause.test()));
+      clause.set_consequent(copy_list(clause.consequent()));
+      break;
+    }
+    case NodeType::kWhileStatement: {
+      auto &statement = static_cast<WhileStatementNode &>(*node);
+      statement.set_test(copy(statement.test()));
+      statement.set_body(copy(statement.body()));
+      break;
+    }
+    case NodeType::kDoWhileStatement: {
+      auto &statement = static_cast<DoWhileStatementNode &>(*node);
+      statement.set_body(copy(statement.body()));
+      statement.set_test(copy(statement.test()));
+      break;
+    }
+    case NodeType::kForStatement: {
+      auto &statement = static_cast<ForStatementNode &>(*node);
+      statement.set_init(copy(statement.init()));
+      statement.set_test(copy(statement.test()));
+      statement.set_update(copy(statement.update()));
+      statement.set_body(copy(statement.body()));
+      break;
+    }
+    case NodeType::kVariableDeclaration: {
+      auto &declaration = static_cast<VariableDeclarationNode &>(*node);
+      declaration.set_declarations(copy_list(declaration.declarations()));
+      break;
+    }
+    case NodeType::kVariableDeclarator: {
+      auto &declarator = static_cast<VariableDeclaratorNode &>(*node);
+      declarator.set_id(copy(declarator.id()));
+      declarator.set_init(copy(declarator.init()));
+      break;
+    }
+    case NodeType::kForInStatement: {
+      auto &statement = static_cast<ForInStatementNode &>(*node);
+      statement.set_left(copy(statement.left()));
+      statement.set_right(copy(statement.right()));
+      statement.set_body(copy(statement.body()));
+      break;
+    }
+    case NodeType::kForOfStatement: {
+      auto &statement = static_cast<ForOfStatementNode &>(*node);
+      statement.set_left(copy(statement.left()));
+      statement.set_right(copy(statement.right()));
+      statement.set_body(copy(statement.body()));
+      break;
+    }
+    case NodeType::kThrowStatement: {
+      auto &statement = static_cast<ThrowStatementNode &>(*node);
+      statement.set_argument(copy(statement.argument()));
+      break;
+    }
+    case NodeType::kTryStatement: {
+      auto &statement = static_cast<TryStatementNode &>(*node);
+      statement.set_block(copy(statement.block()));
+      statement.set_handler(copy(statement.handler()));
+      statement.set_finalizer(copy(statement.finalizer()));
+      break;
+    }
+    case NodeType::kCatchClause: {
+      auto &clause = static_cast<CatchClauseNode &>(*node);
+      clause.set_param(copy(clause.param()));
+      clause.set_body(copy(clause.body()));
+      break;
+    }
+    case NodeType::kFunctionDeclaration:
+      copy_function(static_cast<FunctionDeclarationNode &>(*node));
+      break;
+    case NodeType::kFunctionExpression:
+      copy_function(static_cast<FunctionExpressionNode &>(*node));
+      break;
+    case NodeType::kImportDeclaration: {
+      auto &declaration = static_cast<ImportDeclarationNode &>(*node);
+      declaration.set_specifiers(copy_list(declaration.specifiers()));
+      declaration.set_source(copy(declaration.source()));
+      break;
+    }
+    case NodeType::kImportSpecifier: {
+      auto &specifier = static_cast<ImportSpecifierNode &>(*node);
+      specifier.set_imported(copy(specifier.imported()));
+      specifier.set_local(copy(specifier.local()));
+      break;
+    }
+    case NodeType::kImportDefaultSpecifier: {
+      auto &specifier = static_cast<ImportDefaultSpecifierNode &>(*node);
+      specifier.set_local(copy(specifier.local()));
+      break;
+    }
+    case NodeType::kImportNamespaceSpecifier: {
+      auto &specifier = static_cast<ImportNamespaceSpecifierNode &>(*node);
+      specifier.set_local(copy(specifier.local()));
+      break;
+    }
+    case NodeType::kExportSpecifier: {
+      auto &specifier = static_cast<ExportSpecifierNode &>(*node);
+      specifier.set_local(copy(specifier.local()));
+      specifier.set_exported(copy(specifier.exported()));
+      break;
+    }
+    case NodeType::kExportDefaultSpecifier: {
+      auto &specifier = static_cast<ExportDefaultSpecifierNode &>(*node);
+      specifier.set_local(copy(specifier.local()));
+      break;
+    }
+    case NodeType::kExportNamespaceSpecifier: {
+      auto &specifier = static_cast<ExportNamespaceSpecifierNode &>(*node);
+      specifier.set_local(copy(specifier.local()));
+      break;
+    }
+    case NodeType::kExportNamedDeclaration: {
+      auto &declaration = static_cast<ExportNamedDeclarationNode &>(*node);
+      declaration.set_declaration(copy(declaration.declaration()));
+      declaration.set_specifiers(copy_list(declaration.specifiers()));
+      declaration.set_source(copy(declaration.source()));
+      break;
+    }
+    case NodeType::kExportDefaultDeclaration: {
+      auto &declaration = static_cast<ExportDefaultDeclarationNode &>(*node);
+      declaration.set_declaration(copy(declaration.declaration()));
+      break;
+    }
+    case NodeType::kExportAllDeclaration: {
+      auto &declaration = static_cast<ExportAllDeclarationNode &>(*node);
+      declaration.set_source(copy(declaration.source()));
+      break;
+    }
+    case NodeType::kCallExpression: {
+      auto &call = static_cast<CallExpressionNode &>(*node);
+      call.set_callee(copy(call.callee()));
+      call.set_arguments(copy_list(call.arguments()));
+      break;
+    }
+    case NodeType::kParenthesizedExpression: {
+      auto &expression = static_cast<ParenthesizedExpressionNode &>(*node);
+      expression.set_expression(copy(expression.expression()));
+      break;
+    }
+    default:
+      break;
+    }
+  }
+  return root;
+}
+
+} // namespace
+
+// Statement i of the old program is kept as is when the token after it,
+// the only lookahead its parse saw, ends before the first edited byte.
+// Parsing restarts at the first statement not kept and runs until it lands
+// on the start of an old statement lying wholly in the unedited tail. From
+// there the text and so the parse are unchanged, the rest is reused. Kept
+// statements are shared with the old tree, reused ones are copied with
+// their offsets moved unless the edits kept the length, so the old tree is
+// never written to.
+//
+// Diagnostics follow the statements they were reported in. One reported
+// exactly at a statement start may belong to the statement before, which
+// ended at an unexpected token, so neither end of the reparsed region is
+// placed there.
+SN Parser::Reparse(const SN &program, const vector<TextEdit> &edits) {
+  auto old_program = dynamic_pointer_cast<ProgramNode>(program);
+  if (!old_program || old_program->atoms() != atoms_) {
+    return nullptr;
+  }
+  auto old_lexer = lexer_;
+  auto old_source = old_lexer->source();
+
+  // Bytes before lo and the last suffix bytes are the same in both texts.
+  size_t lo = old_source.size();
+  size_t suffix = old_source.size();
+  size_t size = old_source.size();
+  for (const auto &edit : edits) {
+    if (edit.offset > size || edit.deleted > size - edit.offset) {
+      return nullptr;
+    }
+    lo = min(lo, edit.offset);
+    suffix = min(suffix, size - edit.offset - edit.deleted);
+    size = size - edit.deleted + edit.inserted.size();
+  }
+  string source(old_source);
+  for (const auto &edit : edits) {
+    source.replace(edit.offset, edit.deleted, edit.inserted);
+  }
+  suffix = min(suffix, min(old_source.size(), source.size()) - lo);
+  auto delta = static_cast<int64_t>(source.size()) -
+               static_cast<int64_t>(old_source.size());
+  auto tail = old_source.size() - suffix;
+
+  lexer_ = make_shared<Lexer>(move(source));
+  source_lexer_ = lexer_;
+  // Bindings and references of kept statements may resolve differently
+  // after the edit, so the scopes are rebuilt by a full parse.
+  if (options_.scopes) {
+    diagnostics_->diagnostics().clear();
+    return Parse();
+  }
+  // Lazy bodies of the reused statements report to the same list, so it is
+  // edited in place.
+  auto &diagnostics = diagnostics_->diagnostics();
+  auto old_diagnostics = move(diagnostics);
+  diagnostics.clear();
+  auto has_diagnostic_at = [&](size_t offset) {
+    return any_of(old_diagnostics.begin(), old_diagnostics.end(),
+                  [&](const Diagnostic &diagnostic) {
+                    return diagnostic.offset == offset;
+                  });
+  };
+
+  const auto &old_body = old_program->body();
+  auto count = old_body.size();
+  auto old_start = [&](size_t index) -> size_t {
+    return index < count ? old_body[index]->start() : old_source.size();
+  };
+
+  // Statements [0, kept) are unaffected. The predicate only turns false
+  // once, so binary search for where.
+  size_t kept = 0;
+  size_t high = count;
+  while (kept < high) {
+    auto middle = kept + (high - kept) / 2;
+    if (TokenEnd(old_source, old_start(middle + 1)) < lo) {
+      kept = middle + 1;
+    } else {
+      high = middle;
+    }
+  }
+  while (kept > 0 && has_diagnostic_at(old_start(kept))) {
+    kept--;
+  }
+
+  // First statement that may be reused after the edits.
+  size_t reuse = kept;
+  high = count;
+  while (reuse < high) {
+    auto middle = reuse + (high - reuse) / 2;
+    if (old_start(middle) < tail) {
+      reuse = middle + 1;
+    } else {
+      high = middle;
+    }
+  }
+
+  NodeList body;
+  for (size_t i = 0; i < kept; i++) {
+    body.push_back(old_body[i]);
+  }
+  for (const auto &diagnostic : old_diagnostics) {
+    if (kept > 0 && diagnostic.offset < old_start(kept)) {
+      diagnostics.push_back(diagnostic);
+    }
+  }
+  // Names go into the table of program, whose kept lazy bodies may be
+  // parsed on other threads meanwhile.
+  atoms_ = old_program->atoms();
+  if (!atom_cache_) {
+    atom_cache_ = make_unique<AtomCache>(*atoms_, atoms_->intern_mutex());
+  }
+  lexer_->Seek(kept > 0 ? old_start(kept) : 0);
+  lexer_->GetToken();
+  auto start = kept > 0 ? program->start() : lexer_->token_start();
+  while (true) {
+    auto token_start = static_cast<int64_t>(lexer_->token_start());
+    while (reuse < count && static_cast<int64_t>(old_start(reuse)) + delta < token_start) {
+      reuse++;
+    }
+    if (reuse < count &&
+        static_cast<int64_t>(old_start(reuse)) + delta == token_start &&
+        !has_diagnostic_at(old_start(reuse))) {
+      break;
+    }
+    if (lexer_->current_token() == TokenType::kEofToken) {
+      break;
+    }
+    body.push_back(ParseTopLevelStatement());
+  }
+  for (const auto &diagnostic : old_diagnostics) {
+    if (reuse < count && diagnostic.offset >= old_start(reuse)) {
+      diagnostics.push_back(
+          {static_cast<uint32_t>(diagnostic.offset + delta),
+           diagnostic.message});
+    }
+  }
+  for (; reuse < count; reuse++) {
+    body.push_back(delta == 0 ? old_body[reuse]
+                              : Rebased(old_body[reuse], delta, lexer_));
+  }
+  return NewNode<ProgramNode>(start, SourceType::kModule, move(body), atoms_);
+}
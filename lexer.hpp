@@ -1,9 +1,17 @@
 #pragma once
-#include <sstream>
+#include "line_index.hpp"
+#include "scanner.hpp"
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <memory>
 #include <string>
+#include <algorithm>
+#include <string_view>
+#include <vector>
 using namespace std;
 
-enum class TokenType {
+enum class TokenType : uint8_t {
   kForToken,
   kConstToken,
   kIdentifierToken,
@@ -53,320 +61,781 @@ enum class TokenType {
   kAsToken,
   kFunctionToken,
   kLeftParenToken,
-  kRightParenToken
+  kRightParenToken,
+  kClassToken,
+  kDoToken,
+  kEnumToken,
+  kExtendsToken,
+  kInstanceOfToken,
+  kNewToken,
+  kSuperToken,
+  kThisToken,
+  kTryToken,
+  kWhileToken,
+  kWithToken,
+  kYieldToken,
+  kLeftBracketToken,
+  kRightBracketToken,
+  kDotToken,
+  kEllipsisToken,
+  kQuestionToken,
+  kQuestionDotToken,
+  kQuestionQuestionToken,
+  kQuestionQuestionEqualToken,
+  kArrowToken,
+  kLessThanToken,
+  kLessEqualToken,
+  kLessLessToken,
+  kLessLessEqualToken,
+  kGreaterThanToken,
+  kGreaterEqualToken,
+  kGreaterGreaterToken,
+  kGreaterGreaterEqualToken,
+  kGreaterGreaterGreaterToken,
+  kGreaterGreaterGreaterEqualToken,
+  kNotEqualToken,
+  kNotEqualEqualToken,
+  kAddAddToken,
+  kAddEqualToken,
+  kSubSubToken,
+  kSubEqualToken,
+  kMulEqualToken,
+  kExpToken,
+  kExpEqualToken,
+  kDivEqualToken,
+  kModToken,
+  kModEqualToken,
+  kBitAndToken,
+  kBitAndEqualToken,
+  kAndToken,
+  kAndEqualToken,
+  kBitOrToken,
+  kBitOrEqualToken,
+  kOrToken,
+  kOrEqualToken,
+  kBitXorToken,
+  kBitXorEqualToken,
+  // Number of token types, not a token.
+  kTokenTypeCount
 };
 
-class Lexer {
-  stringstream stream_;
-  int current_line_;
-  int current_col_;
-  TokenType current_token_;
-  string value_;
-  char current_char_ = ' ';
-
-public:
-  Lexer(string source) : stream_(source) {}
-  TokenType GetToken() {
-    value_.clear();
+enum class CharClass : uint8_t {
+  kOther,
+  kWhitespace,
+  kIdentifier,
+  kDigit,
+  kQuote,
+  kPunctuator
+};
 
-    while (true) {
-      if (isspace(current_char_)) {
-        if (stream_.eof()) {
-          current_char_ = EOF;
-          break;
-        }
-        current_char_ = stream_.get();
-      } else {
-        break;
-      }
+inline constexpr array<CharClass, 256> kCharClasses = [] {
+  array<CharClass, 256> classes{};
+  for (char c : {' ', '\t', '\n', '\v', '\f', '\r'}) {
+    classes[c] = CharClass::kWhitespace;
+  }
+  for (int c = 'a'; c <= 'z'; c++) {
+    classes[c] = CharClass::kIdentifier;
+    classes[c - 'a' + 'A'] = CharClass::kIdentifier;
+  }
+  classes['_'] = CharClass::kIdentifier;
+  classes['$'] = CharClass::kIdentifier;
+  for (int c = '0'; c <= '9'; c++) {
+    classes[c] = CharClass::kDigit;
+  }
+  classes['"'] = CharClass::kQuote;
+  classes['\''] = CharClass::kQuote;
+  for (char c : "{}()[];,~:.?<>=!+-*/%&|^") {
+    if (c != '\0') {
+      classes[c] = CharClass::kPunctuator;
     }
+  }
+  return classes;
+}();
 
-    if (isalpha(current_char_)) {
-      while (isalpha(current_char_) || isdigit(current_char_) ||
-             current_char_ == '_') {
-        if (stream_.eof()) {
-          current_char_ = EOF;
-          break;
-        } else {
-          value_ += current_char_;
-          current_char_ = stream_.get();
-        }
-      }
-      if (value_ == "const") {
-        current_token_ = TokenType::kConstToken;
-        return current_token_;
-      }
-      if (value_ == "true") {
-        current_token_ = TokenType::kBooleanToken;
-        return current_token_;
-      }
-      if (value_ == "false") {
-        current_token_ = TokenType::kBooleanToken;
-        return current_token_;
-      }
-      if (value_ == "null") {
-        current_token_ = TokenType::kNullToken;
-        return current_token_;
-      }
-      if (value_ == "typeof") {
-        current_token_ = TokenType::kTypeOfToken;
-        return current_token_;
-      }
-      if (value_ == "void") {
-        current_token_ = TokenType::kVoidToken;
-        return current_token_;
-      }
-      if (value_ == "delete") {
-        current_token_ = TokenType::kDeleteToken;
-        return current_token_;
-      }
-      if (value_ == "throw") {
-        current_token_ = TokenType::kThrowToken;
-        return current_token_;
-      }
-
-      if (value_ == "debugger") {
-        current_token_ = TokenType::kDebuggerToken;
-        return current_token_;
-      }
-
-      if (value_ == "return") {
-        current_token_ = TokenType::kReturnToken;
-        return current_token_;
-      }
+struct Punctuator {
+  const char *text;
+  uint8_t length;
+  TokenType token;
+};
 
-      if (value_ == "continue") {
-        current_token_ = TokenType::kContinueToken;
-        return current_token_;
-      }
+// Grouped by first character, longest first within a group, so the first
+// match is the maximal munch.
+inline constexpr Punctuator kPunctuators[] = {
+    {"{", 1, TokenType::kLeftBraceToken},
+    {"}", 1, TokenType::kRightBraceToken},
+    {"(", 1, TokenType::kLeftParenToken},
+    {")", 1, TokenType::kRightParenToken},
+    {"[", 1, TokenType::kLeftBracketToken},
+    {"]", 1, TokenType::kRightBracketToken},
+    {";", 1, TokenType::kSemiColonToken},
+    {",", 1, TokenType::kCommaToken},
+    {"~", 1, TokenType::kNegToken},
+    {":", 1, TokenType::kColonToken},
+    {"...", 3, TokenType::kEllipsisToken},
+    {".", 1, TokenType::kDotToken},
+    {"?\?=", 3, TokenType::kQuestionQuestionEqualToken},
+    {"??", 2, TokenType::kQuestionQuestionToken},
+    {"?.", 2, TokenType::kQuestionDotToken},
+    {"?", 1, TokenType::kQuestionToken},
+    {"<<=", 3, TokenType::kLessLessEqualToken},
+    {"<<", 2, TokenType::kLessLessToken},
+    {"<=", 2, TokenType::kLessEqualToken},
+    {"<", 1, TokenType::kLessThanToken},
+    {">>>=", 4, TokenType::kGreaterGreaterGreaterEqualToken},
+    {">>>", 3, TokenType::kGreaterGreaterGreaterToken},
+    {">>=", 3, TokenType::kGreaterGreaterEqualToken},
+    {">>", 2, TokenType::kGreaterGreaterToken},
+    {">=", 2, TokenType::kGreaterEqualToken},
+    {">", 1, TokenType::kGreaterThanToken},
+    {"===", 3, TokenType::kEqualEqualEqualToken},
+    {"==", 2, TokenType::kEqualEqualToken},
+    {"=>", 2, TokenType::kArrowToken},
+    {"=", 1, TokenType::kEqualToken},
+    {"!==", 3, TokenType::kNotEqualEqualToken},
+    {"!=", 2, TokenType::kNotEqualToken},
+    {"!", 1, TokenType::kExclaToken},
+    {"++", 2, TokenType::kAddAddToken},
+    {"+=", 2, TokenType::kAddEqualToken},
+    {"+", 1, TokenType::kAddToken},
+    {"--", 2, TokenType::kSubSubToken},
+    {"-=", 2, TokenType::kSubEqualToken},
+    {"-", 1, TokenType::kSubToken},
+    {"**=", 3, TokenType::kExpEqualToken},
+    {"**", 2, TokenType::kExpToken},
+    {"*=", 2, TokenType::kMulEqualToken},
+    {"*", 1, TokenType::kMulToken},
+    {"/=", 2, TokenType::kDivEqualToken},
+    {"/", 1, TokenType::kDivToken},
+    {"%=", 2, TokenType::kModEqualToken},
+    {"%", 1, TokenType::kModToken},
+    {"&&=", 3, TokenType::kAndEqualToken},
+    {"&&", 2, TokenType::kAndToken},
+    {"&=", 2, TokenType::kBitAndEqualToken},
+    {"&", 1, TokenType::kBitAndToken},
+    {"||=", 3, TokenType::kOrEqualToken},
+    {"||", 2, TokenType::kOrToken},
+    {"|=", 2, TokenType::kBitOrEqualToken},
+    {"|", 1, TokenType::kBitOrToken},
+    {"^=", 2, TokenType::kBitXorEqualToken},
+    {"^", 1, TokenType::kBitXorToken},
+};
 
-      if (value_ == "break") {
-        current_token_ = TokenType::kBreakToken;
-        return current_token_;
-      }
+struct PunctuatorGroup {
+  uint8_t first;
+  uint8_t count;
+};
 
-      if (value_ == "if") {
-        current_token_ = TokenType::kIfToken;
-        return current_token_;
-      }
+// First character -> slice of kPunctuators starting with it.
+inline constexpr array<PunctuatorGroup, 256> kPunctuatorGroups = [] {
+  array<PunctuatorGroup, 256> groups{};
+  uint8_t index = 0;
+  for (const auto &punctuator : kPunctuators) {
+    auto &group = groups[static_cast<unsigned char>(punctuator.text[0])];
+    if (group.count == 0) {
+      group.first = index;
+    }
+    group.count++;
+    index++;
+  }
+  return groups;
+}();
 
-      if (value_ == "else") {
-        current_token_ = TokenType::kElseToken;
-        return current_token_;
-      }
+#define KEYWORD(S, T)                                                          \
+  if (word == S) {                                                             \
+    return TokenType::T;                                                       \
+  }
 
-      if (value_ == "switch") {
-        current_token_ = TokenType::kSwitchToken;
-        return current_token_;
-      }
+// Classifies an identifier-shaped word. Switching on length and first
+// character leaves at most three candidates, so a plain identifier costs a
+// couple of compares instead of one per keyword.
+inline TokenType LookupKeyword(string_view word) {
+  switch (word.size()) {
+  case 2:
+    switch (word[0]) {
+    case 'a':
+      KEYWORD("as", kAsToken);
+      break;
+    case 'd':
+      KEYWORD("do", kDoToken);
+      break;
+    case 'i':
+      KEYWORD("if", kIfToken);
+      KEYWORD("in", kInToken);
+      break;
+    case 'o':
+      KEYWORD("of", kOfToken);
+      break;
+    }
+    break;
+  case 3:
+    switch (word[0]) {
+    case 'f':
+      KEYWORD("for", kForToken);
+      break;
+    case 'l':
+      KEYWORD("let", kLetToken);
+      break;
+    case 'n':
+      KEYWORD("new", kNewToken);
+      break;
+    case 't':
+      KEYWORD("try", kTryToken);
+      break;
+    case 'v':
+      KEYWORD("var", kVarToken);
+      break;
+    }
+    break;
+  case 4:
+    switch (word[0]) {
+    case 'c':
+      KEYWORD("case", kCaseToken);
+      break;
+    case 'e':
+      KEYWORD("else", kElseToken);
+      KEYWORD("enum", kEnumToken);
+      break;
+    case 'f':
+      KEYWORD("from", kFromToken);
+      break;
+    case 'n':
+      KEYWORD("null", kNullToken);
+      break;
+    case 't':
+      KEYWORD("this", kThisToken);
+      KEYWORD("true", kBooleanToken);
+      break;
+    case 'v':
+      KEYWORD("void", kVoidToken);
+      break;
+    case 'w':
+      KEYWORD("with", kWithToken);
+      break;
+    }
+    break;
+  case 5:
+    switch (word[0]) {
+    case 'a':
+      KEYWORD("async", kAsyncToken);
+      KEYWORD("await", kAwaitToken);
+      break;
+    case 'b':
+      KEYWORD("break", kBreakToken);
+      break;
+    case 'c':
+      KEYWORD("catch", kCatchToken);
+      KEYWORD("class", kClassToken);
+      KEYWORD("const", kConstToken);
+      break;
+    case 'f':
+      KEYWORD("false", kBooleanToken);
+      break;
+    case 's':
+      KEYWORD("super", kSuperToken);
+      break;
+    case 't':
+      KEYWORD("throw", kThrowToken);
+      break;
+    case 'w':
+      KEYWORD("while", kWhileToken);
+      break;
+    case 'y':
+      KEYWORD("yield", kYieldToken);
+      break;
+    }
+    break;
+  case 6:
+    switch (word[0]) {
+    case 'd':
+      KEYWORD("delete", kDeleteToken);
+      break;
+    case 'e':
+      KEYWORD("export", kExportToken);
+      break;
+    case 'i':
+      KEYWORD("import", kImportToken);
+      break;
+    case 'r':
+      KEYWORD("return", kReturnToken);
+      break;
+    case 's':
+      KEYWORD("switch", kSwitchToken);
+      break;
+    case 't':
+      KEYWORD("typeof", kTypeOfToken);
+      break;
+    }
+    break;
+  case 7:
+    switch (word[0]) {
+    case 'd':
+      KEYWORD("default", kDefaultToken);
+      break;
+    case 'e':
+      KEYWORD("extends", kExtendsToken);
+      break;
+    case 'f':
+      KEYWORD("finally", kFinallyToken);
+      break;
+    }
+    break;
+  case 8:
+    switch (word[0]) {
+    case 'c':
+      KEYWORD("continue", kContinueToken);
+      break;
+    case 'd':
+      KEYWORD("debugger", kDebuggerToken);
+      break;
+    case 'f':
+      KEYWORD("function", kFunctionToken);
+      break;
+    }
+    break;
+  case 10:
+    KEYWORD("instanceof", kInstanceOfToken);
+    break;
+  }
+  return TokenType::kIdentifierToken;
+}
 
-      if (value_ == "case") {
-        current_token_ = TokenType::kCaseToken;
-        return current_token_;
-      }
+#undef KEYWORD
 
-      if (value_ == "default") {
-        current_token_ = TokenType::kDefaultToken;
-        return current_token_;
-      }
+// Every token of an input in structure-of-arrays form, so the parser can
+// walk it by index with constant time lookahead and rewind.
+class TokenBuffer {
+  vector<uint8_t> kinds_;
+  vector<uint32_t> starts_;
+  vector<uint32_t> lengths_;
 
-      if (value_ == "let") {
-        current_token_ = TokenType::kLetToken;
-        return current_token_;
-      }
+public:
+  void Push(TokenType kind, size_t start, size_t length) {
+    kinds_.push_back(static_cast<uint8_t>(kind));
+    starts_.push_back(static_cast<uint32_t>(start));
+    lengths_.push_back(static_cast<uint32_t>(length));
+  }
 
-      if (value_ == "var") {
-        current_token_ = TokenType::kVarToken;
-        return current_token_;
-      }
+  // Appends tokens [from, other.size()) of another buffer.
+  void Append(const TokenBuffer &other, size_t from) {
+    kinds_.insert(kinds_.end(), other.kinds_.begin() + from,
+                  other.kinds_.end());
+    starts_.insert(starts_.end(), other.starts_.begin() + from,
+                   other.starts_.end());
+    lengths_.insert(lengths_.end(), other.lengths_.begin() + from,
+                    other.lengths_.end());
+  }
 
-      if (value_ == "in") {
-        current_token_ = TokenType::kInToken;
-        return current_token_;
-      }
+  void Clear() {
+    kinds_.clear();
+    starts_.clear();
+    lengths_.clear();
+  }
 
-      if (value_ == "of") {
-        current_token_ = TokenType::kOfToken;
-        return current_token_;
-      }
+  // Index of the first token starting at or after offset, or size().
+  size_t LowerBound(size_t offset) const {
+    return lower_bound(starts_.begin(), starts_.end(), offset) -
+           starts_.begin();
+  }
 
-      if (value_ == "await") {
-        current_token_ = TokenType::kAwaitToken;
-        return current_token_;
-      }
+  size_t size() const { return kinds_.size(); }
 
-      if (value_ == "catch") {
-        current_token_ = TokenType::kCatchToken;
-        return current_token_;
-      }
+  TokenType kind(size_t index) const {
+    return static_cast<TokenType>(kinds_[index]);
+  }
+  uint32_t start(size_t index) const { return starts_[index]; }
+  uint32_t length(size_t index) const { return lengths_[index]; }
+};
 
-      if (value_ == "finally") {
-        current_token_ = TokenType::kFinallyToken;
-        return current_token_;
-      }
+class Lexer {
+  string storage_;
+  const char *begin_;
+  const char *end_;
+  const char *cursor_;
+  size_t token_start_ = 0;
+  size_t token_length_ = 0;
+  TokenBuffer tokens_;
+  bool buffered_ = false;
+  size_t token_index_ = 0;
+  unique_ptr<LineIndex> line_index_;
+  TokenType current_token_;
 
-      if (value_ == "async") {
-        current_token_ = TokenType::kAsyncToken;
-        return current_token_;
-      }
+  bool IsEof() const { return cursor_ >= end_; }
 
-      if (value_ == "from") {
-        current_token_ = TokenType::kFromToken;
-        return current_token_;
-      }
+  unsigned char Peek() const { return static_cast<unsigned char>(*cursor_); }
 
-      if (value_ == "import") {
-        current_token_ = TokenType::kImportToken;
-        return current_token_;
-      }
+  TokenType Finish(TokenType token, const char *start, const char *end) {
+    token_start_ = start - begin_;
+    token_length_ = end - start;
+    current_token_ = token;
+    return current_token_;
+  }
 
-      if (value_ == "export") {
-        current_token_ = TokenType::kExportToken;
-        return current_token_;
-      }
+  // Returns true when the cursor sat on a comment and moved past it.
+  bool SkipComment() {
+    if (Peek() != '/' || end_ - cursor_ < 2) {
+      return false;
+    }
+    if (cursor_[1] == '/') {
+      auto newline = static_cast<const char *>(
+          memchr(cursor_ + 2, '\n', end_ - cursor_ - 2));
+      cursor_ = newline ? newline + 1 : end_;
+      return true;
+    }
+    if (cursor_[1] == '*') {
+      auto close = string_view(cursor_ + 2, end_ - cursor_ - 2).find("*/");
+      cursor_ = close == string_view::npos ? end_ : cursor_ + 2 + close + 2;
+      return true;
+    }
+    return false;
+  }
 
-      if (value_ == "as") {
-        current_token_ = TokenType::kAsToken;
-        return current_token_;
-      }
+  static bool IsDigit(char c) { return c >= '0' && c <= '9'; }
 
-      if (value_ == "function") {
-        current_token_ = TokenType::kFunctionToken;
-        return current_token_;
-      }
+  static bool IsHexDigit(char c) {
+    return IsDigit(c) || ((c | 0x20) >= 'a' && (c | 0x20) <= 'f');
+  }
 
-      current_token_ = TokenType::kIdentifierToken;
-      return current_token_;
+  template <typename F> void SkipDigits(F is_digit) {
+    while (!IsEof() && (is_digit(*cursor_) || *cursor_ == '_')) {
+      cursor_++;
     }
+  }
 
-    if (isdigit(current_char_)) {
-      // FIXME: 1.1.1
-      while (isdigit(current_char_) || current_char_ == '.') {
-        if (stream_.eof()) {
-          current_char_ = EOF;
-          break;
+  // Decimal, exponent, hex, octal, binary, legacy octal, `_` separators and
+  // the BigInt `n` suffix. The token spans the whole literal including its
+  // prefix and suffix, parse it with ParseNumber.
+  TokenType LexNumber() {
+    const char *start = cursor_;
+    if (Peek() == '0' && end_ - cursor_ > 1) {
+      char prefix = cursor_[1] | 0x20;
+      if (prefix == 'x' || prefix == 'o' || prefix == 'b') {
+        cursor_ += 2;
+        if (prefix == 'x') {
+          SkipDigits(IsHexDigit);
+        } else if (prefix == 'o') {
+          SkipDigits([](char c) { return c >= '0' && c <= '7'; });
         } else {
-          value_ += current_char_;
-          current_char_ = stream_.get();
+          SkipDigits([](char c) { return c == '0' || c == '1'; });
+        }
+        if (!IsEof() && Peek() == 'n') {
+          cursor_++;
         }
+        return Finish(TokenType::kNumericToken, start, cursor_);
       }
-      current_token_ = TokenType::kNumericToken;
-      return current_token_;
     }
-
-    if (current_char_ == '"') {
-      current_char_ = stream_.get();
-      while (current_char_ != '"') {
-        if (stream_.eof()) {
-          current_char_ = EOF;
-          break;
-        } else {
-          value_ += current_char_;
-          current_char_ = stream_.get();
-        }
+    bool integer = true;
+    SkipDigits(IsDigit);
+    if (!IsEof() && Peek() == '.') {
+      integer = false;
+      cursor_++;
+      SkipDigits(IsDigit);
+    }
+    if (!IsEof() && (Peek() | 0x20) == 'e') {
+      const char *exponent = cursor_ + 1;
+      if (exponent < end_ && (*exponent == '+' || *exponent == '-')) {
+        exponent++;
+      }
+      if (exponent < end_ && IsDigit(*exponent)) {
+        integer = false;
+        cursor_ = exponent;
+        SkipDigits(IsDigit);
       }
-      current_char_ = stream_.get();
-      current_token_ = TokenType::kStringToken;
-      return current_token_;
     }
-
-    if (current_char_ == '+') {
-      current_char_ = stream_.get();
-      current_token_ = TokenType::kAddToken;
-      return current_token_;
+    if (integer && !IsEof() && Peek() == 'n') {
+      cursor_++;
     }
+    return Finish(TokenType::kNumericToken, start, cursor_);
+  }
 
-    if (current_char_ == '-') {
-      current_char_ = stream_.get();
-      current_token_ = TokenType::kSubToken;
-      return current_token_;
+  // The token spans both quotes, view() strips them.
+  TokenType LexString() {
+    const char *start = cursor_;
+    const char quote = *cursor_;
+    cursor_++;
+    while (true) {
+      cursor_ = ScanStringBody(cursor_, end_, quote);
+      if (!IsEof() && Peek() == '\\') {
+        cursor_ = end_ - cursor_ >= 2 ? cursor_ + 2 : end_;
+        continue;
+      }
+      break;
     }
-
-    if (current_char_ == '*') {
-      current_char_ = stream_.get();
-      current_token_ = TokenType::kMulToken;
-      return current_token_;
+    if (!IsEof()) {
+      cursor_++;
     }
+    return Finish(TokenType::kStringToken, start, cursor_);
+  }
 
-    if (current_char_ == '/') {
-      current_char_ = stream_.get();
-      current_token_ = TokenType::kDivToken;
-      return current_token_;
+  // Body of a string token. The closing quote is missing when the input
+  // ends inside the string, in which case a trailing quote is escaped.
+  static string_view StringBody(string_view token) {
+    auto quote = token[0];
+    token.remove_prefix(1);
+    if (token.empty() || token.back() != quote) {
+      return token;
     }
+    size_t backslashes = 0;
+    while (backslashes + 1 < token.size() &&
+           token[token.size() - 2 - backslashes] == '\\') {
+      backslashes++;
+    }
+    if (backslashes % 2 == 0) {
+      token.remove_suffix(1);
+    }
+    return token;
+  }
 
-    if (current_char_ == '!') {
-      current_char_ = stream_.get();
-      current_token_ = TokenType::kExclaToken;
-      return current_token_;
+  TokenType LexPunctuator() {
+    const char *start = cursor_;
+    size_t available = end_ - cursor_;
+    auto group = kPunctuatorGroups[Peek()];
+    for (int i = group.first; i < group.first + group.count; i++) {
+      const auto &punctuator = kPunctuators[i];
+      if (punctuator.length > available ||
+          memcmp(start, punctuator.text, punctuator.length) != 0) {
+        continue;
+      }
+      // `a?.5:b` is a conditional, not an optional chain.
+      if (punctuator.token == TokenType::kQuestionDotToken && available > 2 &&
+          kCharClasses[static_cast<unsigned char>(start[2])] ==
+              CharClass::kDigit) {
+        continue;
+      }
+      cursor_ += punctuator.length;
+      return Finish(punctuator.token, start, cursor_);
     }
+    cursor_++;
+    return ScanToken();
+  }
+
+  TokenType LoadToken(size_t index) {
+    token_index_ = index < tokens_.size() ? index : tokens_.size() - 1;
+    token_start_ = tokens_.start(token_index_);
+    token_length_ = tokens_.length(token_index_);
+    current_token_ = tokens_.kind(token_index_);
+    return current_token_;
+  }
+
+  TokenType ScanToken() {
+    while (true) {
+      cursor_ = ScanWhitespace(cursor_, end_);
+
+      if (IsEof()) {
+        return Finish(TokenType::kEofToken, end_, end_);
+      }
 
-    if (current_char_ == '~') {
-      current_char_ = stream_.get();
-      current_token_ = TokenType::kNegToken;
-      return current_token_;
+      const char *start = cursor_;
+
+      switch (kCharClasses[Peek()]) {
+      case CharClass::kIdentifier: {
+        cursor_ = ScanIdentifier(cursor_ + 1, end_);
+        return Finish(LookupKeyword(string_view(start, cursor_ - start)),
+                      start, cursor_);
+      }
+      case CharClass::kDigit: {
+        return LexNumber();
+      }
+      case CharClass::kQuote: {
+        return LexString();
+      }
+      case CharClass::kPunctuator: {
+        if (SkipComment()) {
+          continue;
+        }
+        if (Peek() == '.' && end_ - cursor_ > 1 && IsDigit(cursor_[1])) {
+          return LexNumber();
+        }
+        return LexPunctuator();
+      }
+      default: {
+        cursor_++;
+        continue;
+      }
+      }
     }
+  }
 
-    if (current_char_ == '{') {
-      current_char_ = stream_.get();
-      current_token_ = TokenType::kLeftBraceToken;
-      return current_token_;
+public:
+  // Owns a copy of the source, tokens are views into that copy.
+  Lexer(string source)
+      : storage_(move(source)), begin_(storage_.data()),
+        end_(storage_.data() + storage_.size()), cursor_(begin_) {}
+
+  // Lexes [begin, end) in place, the caller keeps the buffer alive.
+  Lexer(const char *begin, const char *end)
+      : begin_(begin), end_(end), cursor_(begin) {}
+
+  Lexer(const Lexer &) = delete;
+  Lexer &operator=(const Lexer &) = delete;
+
+  // Starts over on an owned copy of source. The token buffer keeps its
+  // capacity, so a reused lexer stops allocating once it has seen its
+  // largest input.
+  void Reset(string source) {
+    storage_ = move(source);
+    begin_ = storage_.data();
+    end_ = begin_ + storage_.size();
+    cursor_ = begin_;
+    token_start_ = 0;
+    token_length_ = 0;
+    tokens_.Clear();
+    buffered_ = false;
+    token_index_ = 0;
+    line_index_.reset();
+  }
+
+  TokenType GetToken() {
+    if (buffered_) {
+      return LoadToken(token_index_ + 1);
     }
+    return ScanToken();
+  }
 
-    if (current_char_ == '}') {
-      current_char_ = stream_.get();
-      current_token_ = TokenType::kRightBraceToken;
-      return current_token_;
+  // Lexes the whole input into the token buffer up front. GetToken then
+  // walks the buffer and the first call yields the first token.
+  void Tokenize() {
+    tokens_.Clear();
+    cursor_ = begin_;
+    buffered_ = false;
+    while (true) {
+      auto token = ScanToken();
+      tokens_.Push(token, token_start_, token_length_);
+      if (token == TokenType::kEofToken) {
+        break;
+      }
     }
+    buffered_ = true;
+    token_index_ = static_cast<size_t>(-1);
+  }
 
-    if (current_char_ == ';') {
-      current_char_ = stream_.get();
-      current_token_ = TokenType::kSemiColonToken;
-      return current_token_;
+  // Kind of the token n positions after the current one. Constant time on
+  // a tokenized input, otherwise the lexer scans ahead and restores itself.
+  TokenType PeekToken(size_t n = 1) {
+    if (buffered_) {
+      auto index = token_index_ + n;
+      return tokens_.kind(index < tokens_.size() ? index : tokens_.size() - 1);
     }
+    auto cursor = cursor_;
+    auto token_start = token_start_;
+    auto token_length = token_length_;
+    auto current_token = current_token_;
+    auto token = current_token_;
+    for (size_t i = 0; i < n && token != TokenType::kEofToken; i++) {
+      token = ScanToken();
+    }
+    cursor_ = cursor;
+    token_start_ = token_start;
+    token_length_ = token_length;
+    current_token_ = current_token;
+    return token;
+  }
+
+  // Opaque position of the current token for Rewind: the token index on a
+  // tokenized input, its source offset otherwise.
+  size_t Mark() const { return buffered_ ? token_index_ : token_start_; }
 
-    if (current_char_ == ':') {
-      current_char_ = stream_.get();
-      current_token_ = TokenType::kColonToken;
-      return current_token_;
+  void Rewind(size_t mark) {
+    if (buffered_) {
+      LoadToken(mark);
+      return;
     }
+    cursor_ = begin_ + mark;
+    ScanToken();
+  }
 
-    if (current_char_ == '=') {
-      current_char_ = stream_.get();
-      if (current_char_ == '=') {
-        current_char_ = stream_.get();
-        if (current_char_ == '=') {
-          current_token_ = TokenType::kEqualEqualEqualToken;
-          return current_token_;
+  // With the current token on a `{`, moves to the token after its matching
+  // `}` and returns the offset just past that `}`. Nothing in between is
+  // tokenized. Strings and comments are skipped exactly as ScanToken skips
+  // them, so the match is the one a full parse finds.
+  size_t SkipBraces() {
+    if (buffered_) {
+      size_t depth = 0;
+      auto index = token_index_;
+      for (; index + 1 < tokens_.size(); index++) {
+        auto kind = tokens_.kind(index);
+        if (kind == TokenType::kLeftBraceToken) {
+          depth++;
+        } else if (kind == TokenType::kRightBraceToken && --depth == 0) {
+          break;
         }
-        current_token_ = TokenType::kEqualEqualToken;
-        return current_token_;
       }
-      current_token_ = TokenType::kEqualToken;
-      return current_token_;
+      size_t end = tokens_.start(index) + tokens_.length(index);
+      LoadToken(index + 1);
+      return end;
     }
-
-    if(current_char_ == '('){
-      current_char_ = stream_.get();
-      current_token_ = TokenType::kLeftParenToken;
-      return current_token_;
+    size_t depth = 1;
+    while (depth > 0) {
+      cursor_ = ScanBraceBody(cursor_, end_);
+      if (IsEof()) {
+        break;
+      }
+      switch (Peek()) {
+      case '{':
+        depth++;
+        cursor_++;
+        break;
+      case '}':
+        depth--;
+        cursor_++;
+        break;
+      case '/':
+        if (!SkipComment()) {
+          cursor_++;
+        }
+        break;
+      default:
+        LexString();
+        break;
+      }
     }
+    size_t end = cursor_ - begin_;
+    ScanToken();
+    return end;
+  }
 
-    if(current_char_ == ')'){
-      current_char_ = stream_.get();
-      current_token_ = TokenType::kRightParenToken;
-      return current_token_;
-    }
+  // Walks tokens produced elsewhere, e.g. by ParallelTokenize, as if
+  // Tokenize had produced them.
+  void Adopt(TokenBuffer tokens) {
+    tokens_ = move(tokens);
+    buffered_ = true;
+    token_index_ = static_cast<size_t>(-1);
+  }
 
-    if (current_char_ == EOF) {
-      current_token_ = TokenType::kEofToken;
-      return current_token_;
-    }
+  const TokenBuffer &tokens() const { return tokens_; }
 
-    current_char_ = stream_.get();
-    return GetToken();
+  // Moves the scanner to a source offset. Scanning from any offset is well
+  // defined because the lexer keeps no state besides its cursor.
+  void Seek(size_t offset) {
+    cursor_ = begin_ + offset;
+    buffered_ = false;
   }
 
-  string value() { return value_; }
+  // Offset just past the last scanned token.
+  size_t offset() const { return cursor_ - begin_; }
+
+  // Text of the current token, a view into the source buffer. For string
+  // tokens this is the body without quotes, while token_start() and
+  // token_length() cover the quotes.
+  string_view view() const {
+    string_view text(begin_ + token_start_, token_length_);
+    return current_token_ == TokenType::kStringToken ? StringBody(text) : text;
+  }
+
+  string value() const { return string(view()); }
+
+  size_t token_start() const { return token_start_; }
+
+  size_t token_length() const { return token_length_; }
+
+  string_view source() const { return string_view(begin_, end_ - begin_); }
+
+  // Built on first use, lexing itself never tracks lines.
+  const LineIndex &line_index() {
+    if (!line_index_) {
+      line_index_ = make_unique<LineIndex>(source());
+    }
+    return *line_index_;
+  }
 
   TokenType current_token() { return current_token_; }
 };
@@ -0,0 +1,40 @@
+#pragma once
+#include "scanner.hpp"
+#include <algorithm>
+#include <cstdint>
+#include <string_view>
+#include <vector>
+using namespace std;
+
+struct SourcePosition {
+  // 1-based, like ESTree locations.
+  uint32_t line;
+  // 0-based byte column.
+  uint32_t column;
+};
+
+// Start offset of every line, built with one vectorized newline scan. Maps a
+// byte offset to a line and column by binary search.
+class LineIndex {
+  vector<uint32_t> line_starts_;
+
+public:
+  LineIndex(string_view source) {
+    const char *begin = source.data();
+    const char *end = begin + source.size();
+    line_starts_.push_back(0);
+    for (const char *p = ScanNewline(begin, end); p < end;
+         p = ScanNewline(p + 1, end)) {
+      line_starts_.push_back(static_cast<uint32_t>(p + 1 - begin));
+    }
+  }
+
+  SourcePosition GetPosition(size_t offset) const {
+    auto iter =
+        upper_bound(line_starts_.begin(), line_starts_.end(), offset) - 1;
+    return {static_cast<uint32_t>(iter - line_starts_.begin() + 1),
+            static_cast<uint32_t>(offset - *iter)};
+  }
+
+  size_t line_count() const { return line_starts_.size(); }
+};
@@ -41,3 +41,4 @@
   V(ExportAllDeclarationNode)\
   V(CallExpressionNode)\
   V(ParenthesizedExpressionNode)\
+  V(ErrorNode)\
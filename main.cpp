@@ -1,5 +1,7 @@
+#include "dependency_scan.hpp"
 #include "parser.hpp"
 #include <emscripten/bind.h>
+#include <emscripten/val.h>
 #include <iostream>
 #include <memory>
 #include <string>
@@ -23,13 +25,12 @@ EMSCRIPTEN_BINDINGS(nodes) {
   #define BP BINDING_PROPERTY
   #define BC BINDING_CONSTRUCTOR
   #define SN shared_ptr<Node>
-  #define VSN vector<SN>
-  #define SVSN shared_ptr<VSN>
 
   class_<Node>("Node")
   .constructor<NodeType>()
   .smart_ptr<std::shared_ptr<Node>>("Node")
   .property("type",&Node::type)
+  .property("start",&Node::start)
   .function("GenJs",&Node::GenJs)
   .function("Accept",&Node::Accept);
 
@@ -39,14 +40,16 @@ EMSCRIPTEN_BINDINGS(nodes) {
 
   BN(NumericLiteralNode)
   BC(double)
-  BP(NumericLiteralNode,value);
+  BP(NumericLiteralNode,value)
+  BP(NumericLiteralNode,bigint);
 
   BN(NullLiteralNode)
   BC();
 
   BN(StringLiteralNode)
   BC(string)
-  BP(StringLiteralNode,value);
+  BP(StringLiteralNode,value)
+  BP(StringLiteralNode,quote);
 
   BN(BooleanLiteralNode)
   BC(bool)
@@ -67,7 +70,7 @@ EMSCRIPTEN_BINDINGS(nodes) {
   BP(ExpressionStatementNode,expression);
 
   BN(BlockStatementNode)
-  BC(SVSN)
+  BC(NodeList)
   BP(BlockStatementNode,body);
 
 
@@ -93,12 +96,12 @@ EMSCRIPTEN_BINDINGS(nodes) {
   BP(IfStatementNode,alternate);
   
   BN(SwitchStatementNode)
-  BC(SN,SVSN)
+  BC(SN,NodeList)
   BP(SwitchStatementNode,cases)
   BP(SwitchStatementNode,discriminant);
 
   BN(SwitchCaseNode)
-  BC(SN,SVSN)
+  BC(SN,NodeList)
   BP(SwitchCaseNode,consequent)
   BP(SwitchCaseNode,test);
   
@@ -118,7 +121,7 @@ EMSCRIPTEN_BINDINGS(nodes) {
   BP(ForStatementNode,test);
 
   BN(VariableDeclarationNode)
-  BC(VariableDeclarationKind,SVSN)
+  BC(VariableDeclarationKind,NodeList)
   BP(VariableDeclarationNode,kind)
   BP(VariableDeclarationNode,declarations);
 
@@ -141,12 +144,12 @@ EMSCRIPTEN_BINDINGS(nodes) {
   BP(ForOfStatementNode,await);
 
   BN(ProgramNode)
-  BC(SourceType,SVSN)
+  BC(SourceType,NodeList)
   BP(ProgramNode,source_type)
   BP(ProgramNode,body);
 
   BN(ImportDeclarationNode)
-  BC(ImportKind,SVSN,SN)
+  BC(ImportKind,NodeList,SN)
   BP(ImportDeclarationNode,specifiers)
   BP(ImportDeclarationNode,source);
 
@@ -177,7 +180,7 @@ EMSCRIPTEN_BINDINGS(nodes) {
   BP(ExportNamespaceSpecifierNode,local);
 
   BN(ExportNamedDeclarationNode)
-  BC(SN,SVSN,SN)
+  BC(SN,NodeList,SN)
   BP(ExportNamedDeclarationNode,declaration)
   BP(ExportNamedDeclarationNode,source)
   BP(ExportNamedDeclarationNode,specifiers);
@@ -191,7 +194,7 @@ EMSCRIPTEN_BINDINGS(nodes) {
   BP(ExportAllDeclarationNode,source);
 
   BN(CallExpressionNode)
-  BC(SN,SVSN)
+  BC(SN,NodeList)
   BP(CallExpressionNode,callee)
   BP(CallExpressionNode,arguments);
 
@@ -199,16 +202,59 @@ EMSCRIPTEN_BINDINGS(nodes) {
   BC(SN)
   BP(ParenthesizedExpressionNode,expression);
 
+  BN(ErrorNode)
+  BC();
+
   BN(FunctionDeclarationNode)
-  BC(SN,SVSN,SN,bool,bool)
+  BC(SN,NodeList,SN,bool,bool)
   BP(FunctionDeclarationNode,id)
   BP(FunctionDeclarationNode,params)
   BP(FunctionDeclarationNode,body)
   BP(FunctionDeclarationNode,generator)
   BP(FunctionDeclarationNode,async);
 
-  class_<Parser>("Parser").constructor<string>().function("Parse",
-                                                          &Parser::Parse);
+  value_object<SourcePosition>("SourcePosition")
+  .field("line",&SourcePosition::line)
+  .field("column",&SourcePosition::column);
+
+  value_object<Diagnostic>("Diagnostic")
+  .field("offset",&Diagnostic::offset)
+  .field("message",&Diagnostic::message);
+
+  value_object<TextEdit>("TextEdit")
+  .field("offset",&TextEdit::offset)
+  .field("deleted",&TextEdit::deleted)
+  .field("inserted",&TextEdit::inserted);
+
+  class_<Parser>("Parser").constructor<string>()
+  .function("Parse",&Parser::Parse)
+  .function("ParseStreaming",optional_override([](Parser& self, val callback) {
+    self.ParseStreaming([&](SN statement) { callback(statement); });
+  }))
+  .function("Reparse",&Parser::Reparse)
+  .function("GetPosition",&Parser::GetPosition)
+  .function("diagnostics",&Parser::diagnostics);
+
+  enum_<DependencyKind>("DependencyKind")
+  .value("kImport",DependencyKind::kImport)
+  .value("kExportNamed",DependencyKind::kExportNamed)
+  .value("kExportAll",DependencyKind::kExportAll)
+  .value("kExportDefault",DependencyKind::kExportDefault);
+
+  value_object<DependencySpecifier>("DependencySpecifier")
+  .field("name",&DependencySpecifier::name)
+  .field("local",&DependencySpecifier::local);
+
+  value_object<DependencyRecord>("DependencyRecord")
+  .field("kind",&DependencyRecord::kind)
+  .field("source",&DependencyRecord::source)
+  .field("specifiers",&DependencyRecord::specifiers)
+  .field("start",&DependencyRecord::start)
+  .field("end",&DependencyRecord::end);
+
+  emscripten::function("ScanDependencies",optional_override([](string source) {
+    return ScanDependencies(source);
+  }));
 
   #undef BN
   #undef BP
@@ -216,10 +262,22 @@ EMSCRIPTEN_BINDINGS(nodes) {
 }
 
 EMSCRIPTEN_BINDINGS(stl_wrappers) {
-    register_vector<shared_ptr<Node>>("vector<shared_ptr<Node>>")
-    .smart_ptr<std::shared_ptr<vector<shared_ptr<Node>>>>("vector<shared_ptr<Node>>")
-    // .smart_ptr_constructor("vector<shared_ptr<Node>>", &std::make_shared<vector<shared_ptr<Node>>>)
-    .function("pop_back",&vector<shared_ptr<Node>>::pop_back);
+  register_vector<TextEdit>("vector<TextEdit>");
+  register_vector<Diagnostic>("vector<Diagnostic>");
+  register_vector<DependencySpecifier>("vector<DependencySpecifier>");
+  register_vector<DependencyRecord>("vector<DependencyRecord>");
+
+  class_<NodeList>("NodeList")
+    .constructor<>()
+    .function("size",&NodeList::size)
+    .function("push_back",&NodeList::push_back)
+    .function("pop_back",&NodeList::pop_back)
+    .function("get",optional_override([](const NodeList& self, size_t index) {
+      return self[index];
+    }))
+    .function("set",optional_override([](NodeList& self, size_t index, shared_ptr<Node> node) {
+      self[index] = node;
+    }));
 }
 
 #define BINDING_NODE_TYPE_ENUM(V) \
@@ -266,49 +324,27 @@ EMSCRIPTEN_BINDINGS(node_types){
     BINDING_NODE_TYPE_ENUM(kExportDefaultSpecifier)
     BINDING_NODE_TYPE_ENUM(kExportNamedDeclaration)
     BINDING_NODE_TYPE_ENUM(kExportDefaultDeclaration)
-    BINDING_NODE_TYPE_ENUM(kExportAllDeclaration);
+    BINDING_NODE_TYPE_ENUM(kExportAllDeclaration)
+    BINDING_NODE_TYPE_ENUM(kError);
 }
 
-#define BINDING_BINARY_OP(V) \
-  .class_property(#V,&BinaryOperator::V)
+#define BINDING_BINARY_OP(N, S) \
+  .class_property("k" #N "Op",&BinaryOperator::k##N##Op)
 
 EMSCRIPTEN_BINDINGS(binary_ops){
   class_<BinaryOperator>("BinaryOperator")
     .property("source",&BinaryOperator::source)
-    BINDING_BINARY_OP(kEqualEqualOp)
-    BINDING_BINARY_OP(kNotEqualOp)
-    BINDING_BINARY_OP(kEqualEqualEqualOp)
-    BINDING_BINARY_OP(kNotEqualEqualOp)
-    BINDING_BINARY_OP(kLessThanOp)
-    BINDING_BINARY_OP(kLessEqualOp)
-    BINDING_BINARY_OP(kGreaterThanOp)
-    BINDING_BINARY_OP(kGreaterEqualOp)
-    BINDING_BINARY_OP(kLessLessOp)
-    BINDING_BINARY_OP(kGreaterGreaterOp)
-    BINDING_BINARY_OP(kGreaterGreaterGreaterOp)
-    BINDING_BINARY_OP(kAddOp)
-    BINDING_BINARY_OP(kSubOp)
-    BINDING_BINARY_OP(kMulOp)
-    BINDING_BINARY_OP(kDivOp)
-    BINDING_BINARY_OP(kModOp);
+    BINARY_OPERATORS(BINDING_BINARY_OP);
 }
 
-#define BINDING_UNARY_OP(V) \
-  .class_property(#V,&UnaryOperator::V)
+#define BINDING_UNARY_OP(N, S) \
+  .class_property("k" #N "Op",&UnaryOperator::k##N##Op)
 
 EMSCRIPTEN_BINDINGS(unary_ops){
   class_<UnaryOperator>("UnaryOperator")
     .constructor<string>()
     .property("source",&UnaryOperator::source)
-    BINDING_UNARY_OP(kSubOp)
-    BINDING_UNARY_OP(kSubOp)
-    BINDING_UNARY_OP(kAddOp)
-    BINDING_UNARY_OP(kExclaOp)
-    BINDING_UNARY_OP(kNegOp)
-    BINDING_UNARY_OP(kTypeOfOp)
-    BINDING_UNARY_OP(kVoidOp)
-    BINDING_UNARY_OP(kDeleteOp)
-    BINDING_UNARY_OP(kThrowOp);
+    UNARY_OPERATORS(BINDING_UNARY_OP);
 }
 
 
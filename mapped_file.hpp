@@ -0,0 +1,46 @@
+#pragma once
+#include <cstddef>
+#include <fcntl.h>
+#include <string>
+#include <string_view>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+using namespace std;
+
+// Read-only mapping of a whole file, unmapped on destruction. Empty if the
+// file is missing, empty or cannot be mapped.
+class MappedFile {
+  const char *data_ = nullptr;
+  size_t size_ = 0;
+
+public:
+  explicit MappedFile(const string &path) {
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+      return;
+    }
+    struct stat info;
+    if (fstat(fd, &info) == 0 && info.st_size > 0) {
+      auto size = static_cast<size_t>(info.st_size);
+      void *mapped = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+      if (mapped != MAP_FAILED) {
+        data_ = static_cast<const char *>(mapped);
+        size_ = size;
+      }
+    }
+    close(fd);
+  }
+
+  ~MappedFile() {
+    if (data_) {
+      munmap(const_cast<char *>(data_), size_);
+    }
+  }
+
+  MappedFile(const MappedFile &) = delete;
+  MappedFile &operator=(const MappedFile &) = delete;
+
+  string_view data() const { return string_view(data_, size_); }
+  size_t size() const { return size_; }
+};
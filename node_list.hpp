@@ -0,0 +1,159 @@
+#pragma once
+#include "arena.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <utility>
+using namespace std;
+
+class Node;
+
+// Child list held by value inside its node. The first kInlineCapacity
+// children live in the node itself, longer lists move to a single array,
+// from the current ArenaScope's arena if there is one and the heap
+// otherwise. Children are contiguous either way.
+class NodeList {
+public:
+  using value_type = shared_ptr<Node>;
+  using iterator = value_type *;
+  using const_iterator = const value_type *;
+
+  static constexpr size_t kInlineCapacity = 4;
+
+private:
+  value_type *data_;
+  uint32_t size_ = 0;
+  uint32_t capacity_ : 31;
+  // data_ is in an arena, which frees it with everything else there.
+  uint32_t in_arena_ : 1;
+  alignas(value_type) unsigned char inline_[kInlineCapacity *
+                                            sizeof(value_type)];
+
+  value_type *inline_data() { return reinterpret_cast<value_type *>(inline_); }
+
+  bool is_inline() const {
+    return data_ == reinterpret_cast<const value_type *>(inline_);
+  }
+
+  void Grow(size_t capacity) {
+    auto arena = ArenaScope::current();
+    auto bytes = capacity * sizeof(value_type);
+    auto data = static_cast<value_type *>(
+        arena ? arena->Allocate(bytes, alignof(value_type))
+              : ::operator new(bytes));
+    for (size_t i = 0; i < size_; i++) {
+      new (data + i) value_type(move(data_[i]));
+      data_[i].~value_type();
+    }
+    FreeData();
+    data_ = data;
+    capacity_ = static_cast<uint32_t>(capacity);
+    in_arena_ = arena != nullptr;
+  }
+
+  void FreeData() {
+    if (!is_inline() && !in_arena_) {
+      ::operator delete(data_);
+    }
+  }
+
+  // Takes other's children, leaving it empty and inline.
+  void Steal(NodeList &other) {
+    if (other.is_inline()) {
+      for (size_t i = 0; i < other.size_; i++) {
+        push_back(move(other.data_[i]));
+      }
+      other.clear();
+      return;
+    }
+    data_ = other.data_;
+    size_ = other.size_;
+    capacity_ = other.capacity_;
+    in_arena_ = other.in_arena_;
+    other.data_ = other.inline_data();
+    other.size_ = 0;
+    other.capacity_ = kInlineCapacity;
+    other.in_arena_ = false;
+  }
+
+  void Release() {
+    clear();
+    FreeData();
+    data_ = inline_data();
+    capacity_ = kInlineCapacity;
+    in_arena_ = false;
+  }
+
+public:
+  NodeList()
+      : data_(inline_data()), capacity_(kInlineCapacity), in_arena_(false) {}
+
+  NodeList(const NodeList &other) : NodeList() {
+    reserve(other.size_);
+    for (const auto &child : other) {
+      push_back(child);
+    }
+  }
+
+  NodeList(NodeList &&other) : NodeList() { Steal(other); }
+
+  NodeList &operator=(const NodeList &other) {
+    if (this != &other) {
+      clear();
+      reserve(other.size_);
+      for (const auto &child : other) {
+        push_back(child);
+      }
+    }
+    return *this;
+  }
+
+  NodeList &operator=(NodeList &&other) {
+    if (this != &other) {
+      Release();
+      Steal(other);
+    }
+    return *this;
+  }
+
+  ~NodeList() { Release(); }
+
+  void push_back(value_type child) {
+    if (size_ == capacity_) {
+      Grow(capacity_ * 2);
+    }
+    new (data_ + size_) value_type(move(child));
+    size_++;
+  }
+
+  void pop_back() {
+    size_--;
+    data_[size_].~value_type();
+  }
+
+  void reserve(size_t capacity) {
+    if (capacity > capacity_) {
+      Grow(capacity);
+    }
+  }
+
+  void clear() {
+    while (size_ > 0) {
+      pop_back();
+    }
+  }
+
+  size_t size() const { return size_; }
+  bool empty() const { return size_ == 0; }
+
+  value_type &operator[](size_t index) { return data_[index]; }
+  const value_type &operator[](size_t index) const { return data_[index]; }
+  value_type &back() { return data_[size_ - 1]; }
+  const value_type &back() const { return data_[size_ - 1]; }
+
+  iterator begin() { return data_; }
+  iterator end() { return data_ + size_; }
+  const_iterator begin() const { return data_; }
+  const_iterator end() const { return data_ + size_; }
+};
@@ -0,0 +1,111 @@
+#pragma once
+#include <charconv>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <string>
+#include <string_view>
+using namespace std;
+
+struct NumericValue {
+  double value;
+  bool bigint;
+  // Of a BigInt, its source text without the `n`.
+  string_view digits;
+};
+
+inline int DigitValue(char c) {
+  if (c >= '0' && c <= '9') {
+    return c - '0';
+  }
+  return (c | 0x20) - 'a' + 10;
+}
+
+// Integer digits in base 2, 8 or 16, `_` separators skipped, rounded to
+// the nearest double with ties to even like the spec's MV.
+inline double ParseIntegerDigits(string_view digits, int base) {
+  int bits = base == 16 ? 4 : base == 8 ? 3 : 1;
+  // The leading bits, at least 57 of them once full, which leaves room
+  // for the 53 kept and the rounding bit. Bits past those only count
+  // towards the exponent, and whether any was set.
+  uint64_t high = 0;
+  int exponent = 0;
+  bool sticky = false;
+  for (char c : digits) {
+    if (c == '_') {
+      continue;
+    }
+    int digit = DigitValue(c);
+    if (high < uint64_t(1) << (60 - bits)) {
+      high = high << bits | digit;
+    } else {
+      exponent += bits;
+      sticky |= digit != 0;
+    }
+  }
+  // high is far wider than the rounding position, so its lowest bit can
+  // stand in for the dropped ones: it only decides exact ties.
+  if (sticky) {
+    high |= 1;
+  }
+  return ldexp(static_cast<double>(high), exponent);
+}
+
+inline double ParseDecimal(string_view text) {
+  // Integers below 2^53 are exact in a double, skip the float parser.
+  if (text.size() <= 15 &&
+      text.find_first_not_of("0123456789") == string_view::npos) {
+    uint64_t value = 0;
+    for (char c : text) {
+      value = value * 10 + (c - '0');
+    }
+    return static_cast<double>(value);
+  }
+  // Strip separators into a local buffer only when there are any.
+  string stripped;
+  if (text.find('_') != string_view::npos) {
+    stripped.reserve(text.size());
+    for (char c : text) {
+      if (c != '_') {
+        stripped += c;
+      }
+    }
+    text = stripped;
+  }
+#if defined(__cpp_lib_to_chars)
+  double value = 0;
+  from_chars(text.data(), text.data() + text.size(), value);
+  return value;
+#else
+  if (stripped.empty()) {
+    stripped.assign(text);
+  }
+  return strtod(stripped.c_str(), nullptr);
+#endif
+}
+
+// Value of a numeric token as scanned by Lexer::LexNumber, read straight
+// from the source slice.
+inline NumericValue ParseNumber(string_view text) {
+  bool bigint = !text.empty() && text.back() == 'n';
+  if (bigint) {
+    text.remove_suffix(1);
+  }
+  auto digits = bigint ? text : string_view();
+  if (text.size() > 2 && text[0] == '0') {
+    switch (text[1] | 0x20) {
+    case 'x':
+      return {ParseIntegerDigits(text.substr(2), 16), bigint, digits};
+    case 'o':
+      return {ParseIntegerDigits(text.substr(2), 8), bigint, digits};
+    case 'b':
+      return {ParseIntegerDigits(text.substr(2), 2), bigint, digits};
+    }
+  }
+  // Legacy octal: a leading zero followed only by octal digits.
+  if (text.size() > 1 && text[0] == '0' &&
+      text.find_first_not_of("01234567") == string_view::npos) {
+    return {ParseIntegerDigits(text.substr(1), 8), bigint, digits};
+  }
+  return {ParseDecimal(text), bigint, digits};
+}
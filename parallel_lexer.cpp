@@ -0,0 +1,99 @@
+#include "parallel_lexer.hpp"
+
+namespace {
+
+// Chunks smaller than this are not worth a task.
+const size_t kMinChunkSize = 64 * 1024;
+
+struct Chunk {
+  size_t begin;
+  size_t end;
+  TokenBuffer tokens;
+  // Offset just past the last token of the chunk.
+  size_t tail;
+};
+
+// Tokens starting in [begin, end), plus the EOF token for the last chunk.
+void LexChunk(string_view source, Chunk &chunk, bool last) {
+  Lexer lexer(source.data(), source.data() + source.size());
+  lexer.Seek(chunk.begin);
+  chunk.tail = chunk.begin;
+  while (true) {
+    auto token = lexer.GetToken();
+    if (!last && lexer.token_start() >= chunk.end) {
+      break;
+    }
+    chunk.tokens.Push(token, lexer.token_start(), lexer.token_length());
+    chunk.tail = lexer.offset();
+    if (token == TokenType::kEofToken) {
+      break;
+    }
+  }
+}
+
+} // namespace
+
+TokenBuffer ParallelTokenize(string_view source, ThreadPool &pool,
+                             size_t chunk_count) {
+  if (chunk_count == 0) {
+    chunk_count = pool.size() > 0 ? pool.size() * 2 : 1;
+  }
+  chunk_count = min(chunk_count, source.size() / kMinChunkSize + 1);
+
+  // Cut after a newline where possible, lines rarely split a token.
+  vector<Chunk> chunks(chunk_count);
+  size_t begin = 0;
+  for (size_t i = 0; i < chunk_count; i++) {
+    size_t end = source.size();
+    if (i + 1 < chunk_count) {
+      end = max(begin, source.size() * (i + 1) / chunk_count);
+      auto newline = source.find('\n', end);
+      end = newline == string_view::npos ? source.size() : newline + 1;
+    }
+    chunks[i].begin = begin;
+    chunks[i].end = end;
+    begin = end;
+  }
+
+  vector<future<void>> pending;
+  for (size_t i = 0; i < chunk_count; i++) {
+    bool last = i + 1 == chunk_count;
+    pending.push_back(pool.Submit(
+        [source, &chunk = chunks[i], last] { LexChunk(source, chunk, last); }));
+  }
+  for (auto &result : pending) {
+    result.get();
+  }
+
+  TokenBuffer tokens;
+  Lexer lexer(source.data(), source.data() + source.size());
+  size_t cursor = 0;
+  for (size_t i = 0; i < chunk_count; i++) {
+    auto &chunk = chunks[i];
+    bool last = i + 1 == chunk_count;
+    while (true) {
+      lexer.Seek(cursor);
+      auto token = lexer.GetToken();
+      auto start = lexer.token_start();
+      if (!last && start >= chunk.end) {
+        // The rest of this chunk was swallowed by an earlier token.
+        break;
+      }
+      // Same start and kind means the chunk scanned this token from the same
+      // byte, so it agrees with the sequential lex from here on.
+      auto index = chunk.tokens.LowerBound(start);
+      if (index < chunk.tokens.size() && chunk.tokens.start(index) == start &&
+          chunk.tokens.kind(index) == token) {
+        tokens.Append(chunk.tokens, index);
+        cursor = chunk.tail;
+        break;
+      }
+      tokens.Push(token, start, lexer.token_length());
+      cursor = lexer.offset();
+      if (token == TokenType::kEofToken) {
+        break;
+      }
+    }
+  }
+  return tokens;
+}
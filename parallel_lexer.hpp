@@ -0,0 +1,11 @@
+#pragma once
+#include "lexer.hpp"
+#include "thread_pool.hpp"
+
+// Lexes source in chunks on the pool and returns exactly the token stream
+// Lexer::Tokenize produces. Chunks are lexed speculatively from their first
+// byte, then stitched in order: where a chunk began inside a string or a
+// comment the stitcher lexes sequentially until it lands on a token start
+// the chunk also found, and adopts the rest of that chunk from there.
+TokenBuffer ParallelTokenize(string_view source, ThreadPool &pool,
+                             size_t chunk_count = 0);
@@ -0,0 +1,159 @@
+#include "parser.hpp"
+#include "thread_pool.hpp"
+
+namespace {
+
+// Ranges smaller than this are not worth a task.
+const size_t kMinRangeSize = 16 * 1024;
+
+struct StatementRange {
+  size_t begin;
+  size_t end;
+  NodeList body;
+  // Start of the first token the range's parse did not consume.
+  size_t stop;
+};
+
+// Kinds that begin a statement and cannot continue an expression ending in
+// `}`, so a depth-0 `}` followed by one of them ends a statement.
+bool StartsStatementAfterBrace(TokenType token) {
+  switch (token) {
+  case TokenType::kFunctionToken:
+  case TokenType::kAsyncToken:
+  case TokenType::kClassToken:
+  case TokenType::kImportToken:
+  case TokenType::kExportToken:
+  case TokenType::kVarToken:
+  case TokenType::kLetToken:
+  case TokenType::kConstToken:
+  case TokenType::kIfToken:
+  case TokenType::kForToken:
+  case TokenType::kSwitchToken:
+  case TokenType::kTryToken:
+  case TokenType::kThrowToken:
+  case TokenType::kDebuggerToken:
+  case TokenType::kDoToken:
+    return true;
+  default:
+    return false;
+  }
+}
+
+// Offsets of top-level statement starts found from token kinds alone: the
+// token after a depth-0 `;`, or after a depth-0 `}` when it can only begin
+// a new statement. Not every start is found, but every one found is a real
+// start in a well-formed program.
+vector<size_t> FindStatementStarts(const TokenBuffer &tokens) {
+  vector<size_t> starts;
+  size_t depth = 0;
+  for (size_t i = 0; i + 1 < tokens.size(); i++) {
+    switch (tokens.kind(i)) {
+    case TokenType::kLeftBraceToken:
+    case TokenType::kLeftParenToken:
+    case TokenType::kLeftBracketToken:
+      depth++;
+      break;
+    case TokenType::kRightParenToken:
+    case TokenType::kRightBracketToken:
+      if (depth > 0) {
+        depth--;
+      }
+      break;
+    case TokenType::kRightBraceToken:
+      if (depth > 0) {
+        depth--;
+      }
+      if (depth == 0 && StartsStatementAfterBrace(tokens.kind(i + 1))) {
+        starts.push_back(tokens.start(i + 1));
+      }
+      break;
+    case TokenType::kSemiColonToken:
+      if (depth == 0 && tokens.kind(i + 1) != TokenType::kEofToken) {
+        starts.push_back(tokens.start(i + 1));
+      }
+      break;
+    default:
+      break;
+    }
+  }
+  return starts;
+}
+
+} // namespace
+
+// Splits the program at statement starts found by FindStatementStarts into
+// ranges of about equal size, parses each range on the pool with its own
+// Parser, Lexer and arena, and concatenates the statements in source order.
+// Names are interned into this parser's table through a cache per range.
+// A range is handed its end offset and stops at the first token at or past
+// it. If any range stops anywhere else, a boundary was wrong and the
+// program is parsed again sequentially. Syntax errors are collected from
+// all ranges into this parser's diagnostics.
+SN Parser::ParseProgramParallel(ThreadPool &pool) {
+  const auto &tokens = lexer_->tokens();
+  auto source_size = lexer_->source().size();
+  auto start = tokens.start(0);
+
+  size_t task_count = pool.size() > 0 ? pool.size() * 4 : 1;
+  auto target = max(kMinRangeSize, source_size / task_count);
+  vector<StatementRange> ranges;
+  size_t begin = start;
+  for (auto statement_start : FindStatementStarts(tokens)) {
+    if (statement_start - begin >= target) {
+      ranges.push_back({begin, statement_start, {}, 0});
+      begin = statement_start;
+    }
+  }
+  ranges.push_back({begin, source_size, {}, 0});
+
+  // Largest first, so a big function is not the last task to start.
+  vector<StatementRange *> order;
+  for (auto &range : ranges) {
+    order.push_back(&range);
+  }
+  sort(order.begin(), order.end(),
+       [](StatementRange *lhs, StatementRange *rhs) {
+         return lhs->end - lhs->begin > rhs->end - rhs->begin;
+       });
+
+  vector<future<void>> pending;
+  for (auto range : order) {
+    pending.push_back(pool.Submit([this, range] {
+      auto parser = NewViewParser(source_lexer_, options_,
+                                  binary_op_precedence_overrides_,
+                                  range->begin);
+      parser->diagnostics_ = diagnostics_;
+      parser->atoms_ = atoms_;
+      parser->atom_cache_ = make_unique<AtomCache>(*atoms_, atoms_->intern_mutex());
+      auto &lexer = *parser->lexer_;
+      while (lexer.current_token() != TokenType::kEofToken &&
+             lexer.token_start() < range->end) {
+        range->body.push_back(parser->ParseTopLevelStatement());
+      }
+      // EOF starts at source_size, the end of the last range.
+      range->stop = lexer.token_start();
+    }));
+  }
+  for (auto &result : pending) {
+    result.get();
+  }
+
+  NodeList body;
+  for (auto &range : ranges) {
+    if (range.stop != range.end) {
+      diagnostics_->diagnostics().clear();
+      lexer_->Rewind(0);
+      return ParseProgram();
+    }
+    for (auto &statement : range.body) {
+      body.push_back(move(statement));
+    }
+  }
+  // Ranges report in the order they finish.
+  stable_sort(diagnostics_->diagnostics().begin(),
+              diagnostics_->diagnostics().end(),
+              [](const Diagnostic &lhs, const Diagnostic &rhs) {
+                return lhs.offset < rhs.offset;
+              });
+  return NewNode<ProgramNode>(start, SourceType::kModule, move(body), atoms_);
+}
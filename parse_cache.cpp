@@ -0,0 +1,226 @@
+#include "parse_cache.hpp"
+#include "mapped_file.hpp"
+#include "serializer.hpp"
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <unistd.h>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+namespace {
+
+const char kEntrySuffix[] = ".ast";
+// Hex digits of a 128-bit key.
+const size_t kKeyLength = 32;
+
+uint64_t Mix(uint64_t value) {
+  value ^= value >> 33;
+  value *= 0xff51afd7ed558ccdull;
+  value ^= value >> 33;
+  value *= 0xc4ceb9fe1a85ec53ull;
+  value ^= value >> 33;
+  return value;
+}
+
+// Two multiply-rotate lanes over 8-byte words, mixed at the end. Fast and
+// well distributed, not meant to resist chosen collisions.
+void HashSource(string_view source, uint64_t seed, uint64_t hash[2]) {
+  uint64_t high = seed ^ 0x9e3779b97f4a7c15ull;
+  uint64_t low = seed ^ source.size();
+  const char *p = source.data();
+  const char *end = p + source.size();
+  auto round = [&](uint64_t word) {
+    high = ((high ^ word) * 0x87c37b91114253d5ull);
+    high = (high << 31) | (high >> 33);
+    low = ((low + word) * 0x4cf5ad432745937full);
+    low = (low << 27) | (low >> 37);
+  };
+  for (; end - p >= 8; p += 8) {
+    uint64_t word;
+    memcpy(&word, p, sizeof(word));
+    round(word);
+  }
+  if (p < end) {
+    uint64_t word = 0;
+    memcpy(&word, p, end - p);
+    round(word);
+  }
+  hash[0] = Mix(high ^ Mix(low));
+  hash[1] = Mix(low ^ hash[0]);
+}
+
+// Bits of the options that change the tree. Threads, pretokenizing,
+// arenas and lazy bodies only change how it is built.
+uint64_t OptionsBits(const ParserOptions &options) {
+  return options.recover ? 1 : 0;
+}
+
+bool IsEntryName(const string &name) {
+  return name.size() == kKeyLength + strlen(kEntrySuffix) &&
+         name.compare(kKeyLength, string::npos, kEntrySuffix) == 0;
+}
+
+void WriteU64(string &out, uint64_t value) {
+  for (int shift = 0; shift < 64; shift += 8) {
+    out.push_back(static_cast<char>(value >> shift));
+  }
+}
+
+uint64_t ReadU64(const char *data) {
+  uint64_t value = 0;
+  for (int shift = 0; shift < 64; shift += 8) {
+    value |= static_cast<uint64_t>(static_cast<uint8_t>(*data++)) << shift;
+  }
+  return value;
+}
+
+} // namespace
+
+string ParseCacheKey(string_view source, const ParserOptions &options) {
+  uint64_t seed = (static_cast<uint64_t>(kParserVersion) << 32 |
+                   kAstFormatVersion) ^
+                  Mix(OptionsBits(options) + 1);
+  uint64_t hash[2];
+  HashSource(source, seed, hash);
+  return fmt::format("{:016x}{:016x}", hash[0], hash[1]);
+}
+
+ParseCache::ParseCache(string directory, uint64_t max_bytes)
+    : directory_(move(directory)), max_bytes_(max_bytes) {
+  error_code error;
+  fs::create_directories(directory_, error);
+  vector<pair<fs::file_time_type, string>> found;
+  for (const auto &file : fs::directory_iterator(directory_, error)) {
+    auto name = file.path().filename().string();
+    if (!IsEntryName(name)) {
+      continue;
+    }
+    found.emplace_back(file.last_write_time(error), name);
+  }
+  sort(found.begin(), found.end());
+  for (const auto &[time, name] : found) {
+    Insert(name, fs::file_size(EntryPath(name), error));
+  }
+  Evict();
+}
+
+string ParseCache::EntryPath(const string &name) const {
+  return directory_ + "/" + name;
+}
+
+// Maps the entry and decodes it, or returns nullptr if it is missing, for
+// another source size or does not decode.
+SN ParseCache::Load(const string &name, size_t source_size) {
+  MappedFile file(EntryPath(name));
+  auto data = file.data();
+  if (data.size() <= 8 || ReadU64(data.data()) != source_size) {
+    return nullptr;
+  }
+  return DeserializeAst(data.substr(8));
+}
+
+// Writes to a temporary file and renames it over the entry, so readers
+// never see a partial one.
+void ParseCache::Store(const string &name, const string &data) {
+  string temp;
+  {
+    lock_guard<mutex> lock(mutex_);
+    temp = fmt::format("{}.{}.{}.tmp", EntryPath(name), getpid(),
+                       temp_count_++);
+  }
+  {
+    ofstream out(temp, ios::binary | ios::trunc);
+    out.write(data.data(), data.size());
+    if (!out) {
+      out.close();
+      remove(temp.c_str());
+      return;
+    }
+  }
+  error_code error;
+  fs::rename(temp, EntryPath(name), error);
+  if (error) {
+    remove(temp.c_str());
+    return;
+  }
+  lock_guard<mutex> lock(mutex_);
+  Insert(name, data.size());
+  Evict();
+}
+
+// Marks the entry used, here and on disk for other processes.
+void ParseCache::Touch(const string &name) {
+  error_code error;
+  fs::last_write_time(EntryPath(name), fs::file_time_type::clock::now(),
+                      error);
+  lock_guard<mutex> lock(mutex_);
+  auto iter = entries_.find(name);
+  if (iter != entries_.end()) {
+    lru_.splice(lru_.end(), lru_, iter->second.use);
+  }
+}
+
+void ParseCache::Insert(const string &name, uint64_t size) {
+  auto iter = entries_.find(name);
+  if (iter != entries_.end()) {
+    size_ -= iter->second.size;
+    lru_.erase(iter->second.use);
+    entries_.erase(iter);
+  }
+  lru_.push_back(name);
+  entries_[name] = {size, prev(lru_.end())};
+  size_ += size;
+}
+
+void ParseCache::Evict() {
+  while (size_ > max_bytes_ && !lru_.empty()) {
+    auto name = lru_.front();
+    lru_.pop_front();
+    size_ -= entries_[name].size;
+    entries_.erase(name);
+    error_code error;
+    fs::remove(EntryPath(name), error);
+  }
+}
+
+SN ParseCache::Parse(const string &source, ParserOptions options) {
+  auto name = ParseCacheKey(source, options) + kEntrySuffix;
+  if (auto program = Load(name, source.size())) {
+    Touch(name);
+    lock_guard<mutex> lock(mutex_);
+    hits_++;
+    return program;
+  }
+  {
+    lock_guard<mutex> lock(mutex_);
+    misses_++;
+  }
+  Parser parser(source, options);
+  auto program = parser.Parse();
+  string data;
+  WriteU64(data, source.size());
+  // Parses any lazy bodies, whose errors are only reported now.
+  SerializeAst(program, data);
+  if (parser.diagnostics().empty()) {
+    Store(name, data);
+  }
+  return program;
+}
+
+uint64_t ParseCache::hits() {
+  lock_guard<mutex> lock(mutex_);
+  return hits_;
+}
+
+uint64_t ParseCache::misses() {
+  lock_guard<mutex> lock(mutex_);
+  return misses_;
+}
+
+uint64_t ParseCache::size() {
+  lock_guard<mutex> lock(mutex_);
+  return size_;
+}
@@ -0,0 +1,65 @@
+#pragma once
+#include "parser.hpp"
+#include <cstdint>
+#include <list>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+using namespace std;
+
+// Bumped whenever a parser change alters the tree built for some source,
+// which makes every cached tree stale.
+inline constexpr uint32_t kParserVersion = 4;
+
+// Content-addressed cache of parsed trees on disk. An entry is named by a
+// 128-bit hash of the source bytes, the parser and format versions and
+// the options that change the tree, and holds the SerializeAst encoding of
+// the tree. A hit maps the file and decodes it instead of parsing.
+//
+// Entries are evicted least recently used first once they take more than
+// max_bytes. Use is tracked by file modification time, so the order
+// carries over between processes sharing the directory. Each process
+// only counts the entries it has seen, so with several writers the bound
+// is approximate. Sources with syntax errors are parsed every time and not
+// cached. Safe to use from several threads.
+class ParseCache {
+  struct Entry {
+    uint64_t size;
+    // Position in lru_.
+    list<string>::iterator use;
+  };
+
+  string directory_;
+  uint64_t max_bytes_;
+  mutex mutex_;
+  // Entry names, least recently used first.
+  list<string> lru_;
+  unordered_map<string, Entry> entries_;
+  uint64_t size_ = 0;
+  uint64_t hits_ = 0;
+  uint64_t misses_ = 0;
+  uint64_t temp_count_ = 0;
+
+  string EntryPath(const string &name) const;
+  SN Load(const string &name, size_t source_size);
+  void Store(const string &name, const string &data);
+  void Touch(const string &name);
+  void Insert(const string &name, uint64_t size);
+  void Evict();
+
+public:
+  ParseCache(string directory, uint64_t max_bytes);
+
+  // The tree Parser(source, options).Parse() builds, from the cache if an
+  // entry exists.
+  SN Parse(const string &source, ParserOptions options = ParserOptions());
+
+  uint64_t hits();
+  uint64_t misses();
+  // Bytes taken by the entries this process knows of.
+  uint64_t size();
+};
+
+// Hex name of the cache entry for source parsed with options.
+string ParseCacheKey(string_view source, const ParserOptions &options);
@@ -1,5 +1,8 @@
 #include "parser.hpp"
+#include "parallel_lexer.hpp"
 #include "util.hpp"
+#include <atomic>
+#include <climits>
 #include <cstdio>
 #include <cstdlib>
 #include <memory>
@@ -10,69 +13,141 @@
   if (lexer_->current_token() == TokenType::kSemiColonToken) \
   {                                                          \
     lexer_->GetToken();                                      \
+    semicolon_end_ = lexer_->token_start();                  \
   }
 
 #define SN shared_ptr<Node>
-#define VSN vector<SN>
-#define SVSN shared_ptr<VSN>
+
+void Node::Release(SN &child)
+{
+  thread_local vector<SN> pending;
+  thread_local bool releasing = false;
+  if (!child)
+  {
+    return;
+  }
+  pending.push_back(move(child));
+  if (releasing)
+  {
+    return;
+  }
+  // Only the outermost call frees, nodes freed here push their children.
+  releasing = true;
+  while (!pending.empty())
+  {
+    auto node = move(pending.back());
+    pending.pop_back();
+    node.reset();
+  }
+  releasing = false;
+}
 
 SN Parser::ParseStringLiteral()
 {
-  auto value = lexer_->value();
+  auto start = lexer_->token_start();
+  auto value = string(lexer_->view());
+  auto quote = lexer_->source()[start];
   lexer_->GetToken();
-  return make_shared<StringLiteralNode>(value);
+  return NewNode<StringLiteralNode>(start, value, quote);
 }
 
 SN Parser::ParseNumericLiteral()
 {
-  auto value = strtod(lexer_->value().c_str(), nullptr);
+  auto start = lexer_->token_start();
+  auto number = ParseNumber(lexer_->view());
   lexer_->GetToken();
-  return make_shared<NumericLiteralNode>(value);
+  if (number.bigint)
+  {
+    return NewNode<NumericLiteralNode>(start, number.value,
+                                       string(number.digits));
+  }
+  return NewNode<NumericLiteralNode>(start, number.value);
 }
 
 SN Parser::ParseBooleanLiteral()
 {
-  auto value_str = lexer_->value();
+  auto start = lexer_->token_start();
+  auto value = lexer_->view() == "true";
   lexer_->GetToken();
-  if (value_str == "true")
-  {
-    return make_shared<BooleanLiteralNode>(true);
-  }
-  else
-  {
-    return make_shared<BooleanLiteralNode>(false);
-  }
+  return NewNode<BooleanLiteralNode>(start, value);
 }
 
 SN Parser::ParseNullLiteral()
 {
+  auto start = lexer_->token_start();
   lexer_->GetToken();
-  return make_shared<NullLiteralNode>();
+  return NewNode<NullLiteralNode>(start);
 }
 
 void Parser::InstallBinaryOpPrecedences(
     map<BinaryOperator, int> binary_op_precedences)
 {
-  binary_op_precedences_ = binary_op_precedences;
-}
-
-int Parser::GetBinaryOpPrecedence(BinaryOperator op)
-{
-  auto iter = binary_op_precedences_.find(op);
-  if (iter != binary_op_precedences_.end())
+  binary_op_precedence_overrides_ =
+      make_shared<BinaryOpPrecedences>(kBinaryOpPrecedences);
+  for (size_t index = 0; index < kBinaryOpPrecedences.size(); index++)
   {
-    return iter->second;
-  }
-  else
-  {
-    return UNDEFINED;
+    auto token = static_cast<TokenType>(index);
+    if (!CheckIsBianryOp(token))
+    {
+      continue;
+    }
+    auto iter = binary_op_precedences.find(GetBinaryOpFromToken(token));
+    if (iter != binary_op_precedences.end())
+    {
+      (*binary_op_precedence_overrides_)[index] = iter->second;
+    }
   }
+  binary_op_precedences_ = binary_op_precedence_overrides_.get();
 }
 
 BinaryOperator Parser::GetBinaryOpFromToken(TokenType token)
 {
   switch (token)
   {
+  case TokenType::kEqualEqualToken:
+  {
+    return BinaryOperator::kEqualEqualOp;
+  }
+  case TokenType::kNotEqualToken:
+  {
+    return BinaryOperator::kNotEqualOp;
+  }
+  case TokenType::kEqualEqualEqualToken:
+  {
+    return BinaryOperator::kEqualEqualEqualOp;
+  }
+  case TokenType::kNotEqualEqualToken:
+  {
+    return BinaryOperator::kNotEqualEqualOp;
+  }
+  case TokenType::kLessThanToken:
+  {
+    return BinaryOperator::kLessThanOp;
+  }
+  case TokenType::kLessEqualToken:
+  {
+    return BinaryOperator::kLessEqualOp;
+  }
+  case TokenType::kGreaterThanToken:
+  {
+    return BinaryOperator::kGreaterThanOp;
+  }
+  case TokenType::kGreaterEqualToken:
+  {
+    return BinaryOperator::kGreaterEqualOp;
+  }
+  case TokenType::kLessLessToken:
+  {
+    return BinaryOperator::kLessLessOp;
+  }
+  case TokenType::kGreaterGreaterToken:
+  {
+    return BinaryOperator::kGreaterGreaterOp;
+  }
+  case TokenType::kGreaterGreaterGreaterToken:
+  {
+    return BinaryOperator::kGreaterGreaterGreaterOp;
+  }
   case TokenType::kAddToken:
   {
     return BinaryOperator::kAddOp;
@@ -89,6 +164,46 @@ BinaryOperator Parser::GetBinaryOpFromToken(TokenType token)
   {
     return BinaryOperator::kDivOp;
   }
+  case TokenType::kModToken:
+  {
+    return BinaryOperator::kModOp;
+  }
+  case TokenType::kExpToken:
+  {
+    return BinaryOperator::kExpOp;
+  }
+  case TokenType::kBitAndToken:
+  {
+    return BinaryOperator::kBitAndOp;
+  }
+  case TokenType::kBitOrToken:
+  {
+    return BinaryOperator::kBitOrOp;
+  }
+  case TokenType::kBitXorToken:
+  {
+    return BinaryOperator::kBitXorOp;
+  }
+  case TokenType::kAndToken:
+  {
+    return BinaryOperator::kAndOp;
+  }
+  case TokenType::kOrToken:
+  {
+    return BinaryOperator::kOrOp;
+  }
+  case TokenType::kQuestionQuestionToken:
+  {
+    return BinaryOperator::kNullishOp;
+  }
+  case TokenType::kInToken:
+  {
+    return BinaryOperator::kInOp;
+  }
+  case TokenType::kInstanceOfToken:
+  {
+    return BinaryOperator::kInstanceOfOp;
+  }
   default:
   {
     UNREACHABLE;
@@ -97,22 +212,25 @@ BinaryOperator Parser::GetBinaryOpFromToken(TokenType token)
 }
 
 bool Parser::CheckIsBianryOp(TokenType token)
+{
+  return kBinaryOpPrecedences[static_cast<size_t>(token)] != UNDEFINED;
+}
+
+namespace
+{
+
+// Words with a token of their own that are only reserved in some
+// contexts, so they still name bindings.
+bool IsContextualKeyword(TokenType token)
 {
   switch (token)
   {
-  case TokenType::kAddToken:
-  {
-    return true;
-  }
-  case TokenType::kSubToken:
-  {
-    return true;
-  }
-  case TokenType::kMulToken:
-  {
-    return true;
-  }
-  case TokenType::kDivToken:
+  case TokenType::kAsToken:
+  case TokenType::kOfToken:
+  case TokenType::kFromToken:
+  case TokenType::kAsyncToken:
+  case TokenType::kAwaitToken:
+  case TokenType::kYieldToken:
   {
     return true;
   }
@@ -123,70 +241,76 @@ bool Parser::CheckIsBianryOp(TokenType token)
   }
 }
 
-SN Parser::ParseBinaryExpression(SN left,
-                                               int precedence)
+} // namespace
+
+// A binding or reference name. Anything else is reported and left for
+// Recover to skip, so callers looping over names stop once panicking_.
+SN Parser::ParseIdentifier()
 {
-  while (1)
+  auto token = lexer_->current_token();
+  if (token == TokenType::kEofToken)
   {
-    if (CheckIsBianryOp(lexer_->current_token()))
-    {
-      auto op = GetBinaryOpFromToken(lexer_->current_token());
-      auto next_precedence = GetBinaryOpPrecedence(op);
-      if (next_precedence <= precedence)
-      {
-        return left;
-      }
-      else
-      {
-        lexer_->GetToken();
-        auto next_left = ParseUnaryExpression();
-        auto next_right =
-            ParseBinaryExpression(move(next_left), next_precedence);
-        left =
-            make_shared<BinaryExpressionNode>(op, move(left), move(next_right));
-      }
-    }
-    else
-    {
-      return left;
-    }
+    return Error("Unexpected end of input");
   }
+  if (token != TokenType::kIdentifierToken && !IsContextualKeyword(token))
+  {
+    return Error("Expected identifier");
+  }
+  auto start = lexer_->token_start();
+  auto name = Intern(lexer_->view());
+  lexer_->GetToken();
+  return NewNode<IdentifierNode>(start, name, atoms_.get());
 }
 
-SN Parser::ParseIdentifier()
+// Any identifier-shaped word, reserved ones included, for the imported
+// and exported names of module specifiers such as `export { a as default }`.
+SN Parser::ParseIdentifierName()
 {
-  auto name = lexer_->value();
+  auto view = lexer_->view();
+  if (lexer_->current_token() == TokenType::kStringToken || view.empty() ||
+      kCharClasses[static_cast<unsigned char>(view[0])] !=
+          CharClass::kIdentifier)
+  {
+    return ParseIdentifier();
+  }
+  auto start = lexer_->token_start();
+  auto name = Intern(lexer_->view());
   lexer_->GetToken();
-  return make_shared<IdentifierNode>(name);
+  return NewNode<IdentifierNode>(start, name, atoms_.get());
 }
 
 SN Parser::ParseCallExpression(SN callee)
 {
   auto arguments = ParseCallExpressionArguments();
-  return make_shared<CallExpressionNode>(move(callee), move(arguments));
+  return NewNode<CallExpressionNode>(callee->start(), move(callee),
+                                     move(arguments));
 }
 
-SVSN Parser::ParseCallExpressionArguments()
+NodeList Parser::ParseCallExpressionArguments()
 {
   lexer_->GetToken();
-  SVSN params = make_shared<VSN>();
-  while (lexer_->current_token() != TokenType::kRightParenToken)
+  NodeList params;
+  while (lexer_->current_token() != TokenType::kRightParenToken &&
+         lexer_->current_token() != TokenType::kEofToken && !panicking_)
   {
     auto param = ParseIdentifier();
-    params->push_back(move(param));
+    ReferenceBinding(param);
+    params.push_back(move(param));
     if (lexer_->current_token() == TokenType::kCommaToken)
     {
       lexer_->GetToken();
     }
   }
-  lexer_->GetToken();
+  Expect(TokenType::kRightParenToken, "Expected ')'");
   return params;
 }
 
 SN Parser::ParseIdentifierOrCallExpression()
 {
-  auto name = lexer_->value();
-  auto identifier = make_shared<IdentifierNode>(name);
+  auto start = lexer_->token_start();
+  auto name = Intern(lexer_->view());
+  auto identifier = NewNode<IdentifierNode>(start, name, atoms_.get());
+  ReferenceBinding(identifier);
   lexer_->GetToken();
   if (lexer_->current_token() == TokenType::kLeftParenToken)
   {
@@ -198,112 +322,257 @@ SN Parser::ParseIdentifierOrCallExpression()
   }
 }
 
-SN Parser::ParseUnaryExpression()
+UnaryOperator Parser::GetUnaryOpFromToken(TokenType token)
 {
-  switch (lexer_->current_token())
+  switch (token)
   {
-  case TokenType::kLeftParenToken:
+  case TokenType::kAddToken:
   {
-    lexer_->GetToken();
-    auto expression = ParseExpression();
-    lexer_->GetToken();
-    return make_shared<ParenthesizedExpressionNode>(move(expression));
+    return UnaryOperator::kAddOp;
   }
-  case TokenType::kIdentifierToken:
+  case TokenType::kSubToken:
   {
-    return ParseIdentifierOrCallExpression();
+    return UnaryOperator::kSubOp;
   }
-  case TokenType::kNumericToken:
+  case TokenType::kExclaToken:
   {
-    return ParseNumericLiteral();
+    return UnaryOperator::kExclaOp;
   }
-  case TokenType::kStringToken:
+  case TokenType::kNegToken:
   {
-    return ParseStringLiteral();
+    return UnaryOperator::kNegOp;
   }
-  case TokenType::kAddToken:
+  case TokenType::kTypeOfToken:
   {
-    lexer_->GetToken();
-    auto expr = ParseUnaryExpression();
-    return make_shared<UnaryExpressionNode>(UnaryOperator::kAddOp, move(expr));
+    return UnaryOperator::kTypeOfOp;
   }
-  case TokenType::kSubToken:
+  case TokenType::kVoidToken:
   {
-    lexer_->GetToken();
-    auto expr = ParseUnaryExpression();
-    return make_shared<UnaryExpressionNode>(UnaryOperator::kSubOp, move(expr));
+    return UnaryOperator::kVoidOp;
   }
-  case TokenType::kExclaToken:
+  case TokenType::kDeleteToken:
   {
-    lexer_->GetToken();
-    auto expr = ParseUnaryExpression();
-    return make_shared<UnaryExpressionNode>(UnaryOperator::kExclaOp,
-                                            move(expr));
+    return UnaryOperator::kDeleteOp;
   }
-  case TokenType::kNegToken:
+  case TokenType::kThrowToken:
   {
-    lexer_->GetToken();
-    auto expr = ParseUnaryExpression();
-    return make_shared<UnaryExpressionNode>(UnaryOperator::kNegOp, move(expr));
+    return UnaryOperator::kThrowOp;
   }
-  case TokenType::kTypeOfToken:
+  default:
   {
-    lexer_->GetToken();
-    auto expr = ParseUnaryExpression();
-    return make_shared<UnaryExpressionNode>(UnaryOperator::kTypeOfOp,
-                                            move(expr));
+    UNREACHABLE;
   }
+  }
+}
+
+bool Parser::CheckIsUnaryOp(TokenType token)
+{
+  switch (token)
+  {
+  case TokenType::kAddToken:
+  case TokenType::kSubToken:
+  case TokenType::kExclaToken:
+  case TokenType::kNegToken:
+  case TokenType::kTypeOfToken:
   case TokenType::kVoidToken:
+  case TokenType::kDeleteToken:
+  case TokenType::kThrowToken:
   {
-    lexer_->GetToken();
-    auto expr = ParseUnaryExpression();
-    return make_shared<UnaryExpressionNode>(UnaryOperator::kVoidOp, move(expr));
+    return true;
   }
-  case TokenType::kDeleteToken:
+  default:
   {
-    lexer_->GetToken();
-    auto expr = ParseUnaryExpression();
-    return make_shared<UnaryExpressionNode>(UnaryOperator::kDeleteOp,
-                                            move(expr));
+    return false;
   }
-  case TokenType::kThrowToken:
+  }
+}
+
+SN Parser::ParsePrimaryExpression()
+{
+  switch (lexer_->current_token())
   {
-    lexer_->GetToken();
-    auto expr = ParseUnaryExpression();
-    return make_shared<UnaryExpressionNode>(UnaryOperator::kThrowOp,
-                                            move(expr));
+  case TokenType::kIdentifierToken:
+  {
+    return ParseIdentifierOrCallExpression();
+  }
+  case TokenType::kNumericToken:
+  {
+    return ParseNumericLiteral();
+  }
+  case TokenType::kStringToken:
+  {
+    return ParseStringLiteral();
+  }
+  case TokenType::kBooleanToken:
+  {
+    return ParseBooleanLiteral();
+  }
+  case TokenType::kNullToken:
+  {
+    return ParseNullLiteral();
+  }
+  case TokenType::kFunctionToken:
+  {
+    return ParseFunctionExpression();
+  }
+  case TokenType::kAsyncToken:
+  {
+    if (lexer_->PeekToken() == TokenType::kFunctionToken)
+    {
+      return ParseFunctionExpression();
+    }
+    return Error("Unexpected token");
   }
   default:
   {
-    return nullptr;
+    return Error("Unexpected token");
   }
   }
 }
 
+// Operator precedence parsing on explicit stacks, so neither a long
+// operator chain nor deeply nested parens and prefix operators use any
+// native stack. Prefix operators and `(` are pushed until a primary
+// expression, prefix operators then apply to it at once. A binary operator
+// first reduces the pending binary operators that bind at least as tight,
+// which for a right associative one means strictly tighter, so
+// `a ** b ** c` groups as `a ** (b ** c)`. A `)` reduces down to its `(`.
+//
+// With unary set, only a unary expression is parsed: binary operators are
+// taken inside parens only, as the left side of a for-in head needs.
+SN Parser::ParseOperatorExpression(bool unary)
+{
+  auto &operators = pending_operators_;
+  auto &operands = pending_operands_;
+  auto operator_base = operators.size();
+  [[maybe_unused]] auto operand_base = operands.size();
+  size_t parens = 0;
+
+  auto reduce_binary = [&]()
+  {
+    auto token = operators.back().token;
+    operators.pop_back();
+    auto right = move(operands.back());
+    operands.pop_back();
+    auto left = move(operands.back());
+    operands.back() = NewNode<BinaryExpressionNode>(
+        left->start(), GetBinaryOpFromToken(token), move(left), move(right));
+  };
+  auto reduce_prefixes = [&]()
+  {
+    while (operators.size() > operator_base &&
+           operators.back().kind == PendingOperator::Kind::kUnary)
+    {
+      auto &pending = operators.back();
+      operands.back() = NewNode<UnaryExpressionNode>(
+          pending.start, GetUnaryOpFromToken(pending.token),
+          move(operands.back()));
+      operators.pop_back();
+    }
+  };
+  // Reduces binary operators that bind at least as tight as precedence.
+  auto reduce_above = [&](int precedence)
+  {
+    while (operators.size() > operator_base &&
+           operators.back().kind == PendingOperator::Kind::kBinary &&
+           (operators.back().precedence > precedence ||
+            (operators.back().precedence == precedence &&
+             !CheckIsRightAssociative(operators.back().token))))
+    {
+      reduce_binary();
+    }
+  };
+  auto close_paren = [&]()
+  {
+    reduce_above(INT_MIN);
+    auto start = operators.back().start;
+    operators.pop_back();
+    parens--;
+    operands.back() = NewNode<ParenthesizedExpressionNode>(
+        start, move(operands.back()));
+    reduce_prefixes();
+  };
+
+  while (1)
+  {
+    auto token = lexer_->current_token();
+    if (CheckIsUnaryOp(token))
+    {
+      operators.push_back({PendingOperator::Kind::kUnary, token, 0,
+                           static_cast<uint32_t>(lexer_->token_start())});
+      lexer_->GetToken();
+      continue;
+    }
+    if (token == TokenType::kLeftParenToken)
+    {
+      operators.push_back({PendingOperator::Kind::kParen, token, 0,
+                           static_cast<uint32_t>(lexer_->token_start())});
+      parens++;
+      lexer_->GetToken();
+      continue;
+    }
+    operands.push_back(ParsePrimaryExpression());
+    reduce_prefixes();
+
+    // Closes parens until an operator continues the expression.
+    while (1)
+    {
+      token = lexer_->current_token();
+      auto precedence = GetBinaryOpPrecedence(token);
+      if (precedence != UNDEFINED && (!unary || parens > 0))
+      {
+        reduce_above(precedence);
+        operators.push_back(
+            {PendingOperator::Kind::kBinary, token, precedence, 0});
+        lexer_->GetToken();
+        break;
+      }
+      if (parens == 0)
+      {
+        reduce_above(INT_MIN);
+        auto expression = move(operands.back());
+        operands.pop_back();
+        assert(operators.size() == operator_base &&
+               operands.size() == operand_base);
+        return expression;
+      }
+      Expect(TokenType::kRightParenToken, "Expected ')'");
+      close_paren();
+    }
+  }
+}
+
+SN Parser::ParseUnaryExpression()
+{
+  return ParseOperatorExpression(true);
+}
+
 SN Parser::ParseExpression()
 {
-  auto left = ParseUnaryExpression();
-  return ParseBinaryExpression(move(left), -1);
+  return ParseOperatorExpression(false);
 }
 
 SN Parser::ParseExpressionStatement()
 {
+  auto start = lexer_->token_start();
   auto expression = ParseExpression();
   SKIP_SEMICOLON;
-  return make_shared<ExpressionStatementNode>(move(expression));
+  return NewNode<ExpressionStatementNode>(start, move(expression));
 }
 
 SN Parser::ParseEmptyStatement()
 {
+  auto start = lexer_->token_start();
   SKIP_SEMICOLON;
-  return make_shared<EmptyStatementNode>();
+  return NewNode<EmptyStatementNode>(start);
 }
 
 SN Parser::ParseDebuggerStatement()
 {
+  auto start = lexer_->token_start();
   lexer_->GetToken();
   SKIP_SEMICOLON;
-  return make_shared<DebuggerStatementNode>();
+  return NewNode<DebuggerStatementNode>(start);
 }
 
 SN Parser::ParseStatement()
@@ -351,47 +620,100 @@ SN Parser::ParseStatement()
   }
 }
 
+// Blocks nested directly in blocks are opened on an explicit stack rather
+// than by recursion. A nested block is a statement of the enclosing one and
+// recovers from errors the way ParseStatementListItem would.
 SN Parser::ParseBlockStatement()
 {
+  struct OpenBlock
+  {
+    size_t start;
+    NodeList body;
+    // panicking_ of the enclosing statement.
+    bool panicking;
+    // Scope depth to close back to.
+    size_t scope_depth;
+  };
+  vector<OpenBlock> blocks;
+  auto start = lexer_->token_start();
+  blocks.push_back(
+      {start, {}, false, scope_builder_.Open(ScopeKind::kBlock, start)});
   lexer_->GetToken();
-  SVSN body = make_shared<VSN>();
-  while (lexer_->current_token() != TokenType::kRightBraceToken)
+  while (1)
   {
-    auto statement = ParseStatement();
-    body->push_back(move(statement));
+    auto token = lexer_->current_token();
+    if (token == TokenType::kLeftBraceToken)
+    {
+      start = lexer_->token_start();
+      blocks.push_back({start, {}, panicking_,
+                        scope_builder_.Open(ScopeKind::kBlock, start)});
+      panicking_ = false;
+      lexer_->GetToken();
+      continue;
+    }
+    if (token != TokenType::kRightBraceToken &&
+        token != TokenType::kEofToken)
+    {
+      blocks.back().body.push_back(ParseStatementListItem());
+      continue;
+    }
+    Expect(TokenType::kRightBraceToken, "Expected '}'");
+    auto &block = blocks.back();
+    scope_builder_.CloseTo(block.scope_depth);
+    SN node = NewNode<BlockStatementNode>(block.start, move(block.body));
+    if (blocks.size() == 1)
+    {
+      return node;
+    }
+    if (panicking_)
+    {
+      Synchronize();
+      node = NewNode<ErrorNode>(block.start);
+    }
+    panicking_ = block.panicking;
+    blocks.pop_back();
+    blocks.back().body.push_back(move(node));
   }
-  lexer_->GetToken();
-  return make_shared<BlockStatementNode>(move(body));
 }
 
 SN Parser::ParseReturnStatement()
 {
+  auto start = lexer_->token_start();
   lexer_->GetToken();
-  auto argument = ParseExpression();
+  SN argument = nullptr;
+  if (lexer_->current_token() != TokenType::kSemiColonToken &&
+      lexer_->current_token() != TokenType::kRightBraceToken &&
+      lexer_->current_token() != TokenType::kEofToken)
+  {
+    argument = ParseExpression();
+  }
   SKIP_SEMICOLON;
-  return make_shared<ReturnStatementNode>(move(argument));
+  return NewNode<ReturnStatementNode>(start, move(argument));
 }
 
 SN Parser::ParseContinueStatement()
 {
+  auto start = lexer_->token_start();
   lexer_->GetToken();
   SKIP_SEMICOLON;
-  return make_shared<ContinueStatementNode>();
+  return NewNode<ContinueStatementNode>(start);
 }
 
 SN Parser::ParseBreakStatement()
 {
+  auto start = lexer_->token_start();
   lexer_->GetToken();
   SKIP_SEMICOLON;
-  return make_shared<BreakStatementNode>();
+  return NewNode<BreakStatementNode>(start);
 }
 
 SN Parser::ParseIfStatement()
 {
+  auto start = lexer_->token_start();
   lexer_->GetToken();
-  lexer_->GetToken();
+  Expect(TokenType::kLeftParenToken, "Expected '('");
   auto test = ParseExpression();
-  lexer_->GetToken();
+  Expect(TokenType::kRightParenToken, "Expected ')'");
   auto consequent = ParseStatement();
   SN alternate = nullptr;
   if (lexer_->current_token() == TokenType::kElseToken)
@@ -399,67 +721,72 @@ SN Parser::ParseIfStatement()
     lexer_->GetToken();
     alternate = ParseStatement();
   }
-  return make_shared<IfStatementNode>(move(test), move(consequent),
-                                      move(alternate));
+  return NewNode<IfStatementNode>(start, move(test), move(consequent),
+                                  move(alternate));
 }
 
 SN Parser::ParseSwitchNodeStatement()
 {
+  auto start = lexer_->token_start();
   lexer_->GetToken();
   SN test = nullptr;
   if (lexer_->current_token() != TokenType::kColonToken)
   {
     test = ParseExpression();
   }
-  lexer_->GetToken();
-  SVSN consequent = make_shared<VSN>();
+  Expect(TokenType::kColonToken, "Expected ':'");
+  NodeList consequent;
   while (lexer_->current_token() != TokenType::kCaseToken &&
          lexer_->current_token() != TokenType::kDefaultToken &&
-         lexer_->current_token() != TokenType::kRightBraceToken)
+         lexer_->current_token() != TokenType::kRightBraceToken &&
+         lexer_->current_token() != TokenType::kEofToken)
   {
-    auto statement = ParseStatement();
-    consequent->push_back(move(statement));
+    auto statement = ParseStatementListItem();
+    consequent.push_back(move(statement));
   }
-  return make_shared<SwitchCaseNode>(move(test), move(consequent));
+  return NewNode<SwitchCaseNode>(start, move(test), move(consequent));
 }
 
 SN Parser::ParseSwitchStatement()
 {
+  auto start = lexer_->token_start();
   lexer_->GetToken();
-  lexer_->GetToken();
+  Expect(TokenType::kLeftParenToken, "Expected '('");
   auto discriminant = ParseExpression();
-  lexer_->GetToken();
-  lexer_->GetToken();
+  Expect(TokenType::kRightParenToken, "Expected ')'");
+  Expect(TokenType::kLeftBraceToken, "Expected '{'");
 
-  SVSN cases = make_shared<VSN>();
+  NodeList cases;
   while (lexer_->current_token() == TokenType::kCaseToken ||
          lexer_->current_token() == TokenType::kDefaultToken)
   {
-    cases->push_back(ParseSwitchNodeStatement());
+    cases.push_back(ParseSwitchNodeStatement());
   }
-  lexer_->GetToken();
-  return make_shared<SwitchStatementNode>(move(discriminant), move(cases));
+  Expect(TokenType::kRightBraceToken, "Expected '}'");
+  return NewNode<SwitchStatementNode>(start, move(discriminant), move(cases));
 }
 
 SN Parser::ParseWhileStatement()
 {
+  auto start = lexer_->token_start();
   lexer_->GetToken();
-  lexer_->GetToken();
+  Expect(TokenType::kLeftParenToken, "Expected '('");
   auto test = ParseExpression();
-  lexer_->GetToken();
+  Expect(TokenType::kRightParenToken, "Expected ')'");
   auto body = ParseStatement();
-  return make_shared<WhileStatementNode>(move(test), move(body));
+  return NewNode<WhileStatementNode>(start, move(test), move(body));
 }
 
 SN Parser::ParseDoWhileStatement()
 {
+  auto start = lexer_->token_start();
   lexer_->GetToken();
   auto body = ParseStatement();
-  lexer_->GetToken();
-  lexer_->GetToken();
+  Expect(TokenType::kWhileToken, "Expected 'while'");
+  Expect(TokenType::kLeftParenToken, "Expected '('");
   auto test = ParseExpression();
-  lexer_->GetToken();
-  return make_shared<DoWhileStatementNode>(move(test), move(body));
+  Expect(TokenType::kRightParenToken, "Expected ')'");
+  return NewNode<DoWhileStatementNode>(start, move(test), move(body));
 };
 
 VariableDeclarationKind
@@ -488,6 +815,7 @@ Parser::GetVariableDeclarationKindFromToken(TokenType token)
 
 SN Parser::ParseVariableDeclarator()
 {
+  auto start = lexer_->token_start();
   auto id = ParseIdentifier();
   SN init = nullptr;
   if (lexer_->current_token() == TokenType::kEqualToken)
@@ -495,18 +823,26 @@ SN Parser::ParseVariableDeclarator()
     lexer_->GetToken();
     init = ParseExpression();
   }
-  return make_shared<VariableDeclaratorNode>(move(id), move(init));
+  return NewNode<VariableDeclaratorNode>(start, move(id), move(init));
 }
 
 SN Parser::ParseVariableDeclaration()
 {
+  auto start = lexer_->token_start();
   auto kind = GetVariableDeclarationKindFromToken(lexer_->current_token());
+  auto binding_kind =
+      lexer_->current_token() == TokenType::kVarToken   ? BindingKind::kVar
+      : lexer_->current_token() == TokenType::kLetToken ? BindingKind::kLet
+                                                        : BindingKind::kConst;
   lexer_->GetToken();
-  SVSN declarations = make_shared<VSN>();
+  NodeList declarations;
   while (1)
   {
     auto declaration = ParseVariableDeclarator();
-    declarations->push_back(move(declaration));
+    DeclareBinding(
+        static_cast<const VariableDeclaratorNode &>(*declaration).id(),
+        binding_kind);
+    declarations.push_back(move(declaration));
     if (lexer_->current_token() == TokenType::kCommaToken)
     {
       lexer_->GetToken();
@@ -518,7 +854,7 @@ SN Parser::ParseVariableDeclaration()
     }
   }
   SKIP_SEMICOLON;
-  return make_shared<VariableDeclarationNode>(kind, move(declarations));
+  return NewNode<VariableDeclarationNode>(start, kind, move(declarations));
 }
 
 bool Parser::CheckIsVariableDeclaration(TokenType token)
@@ -540,6 +876,8 @@ bool Parser::CheckIsVariableDeclaration(TokenType token)
 
 SN Parser::ParseForStatement()
 {
+  auto start = lexer_->token_start();
+  auto scope_depth = scope_builder_.Open(ScopeKind::kBlock, start);
   lexer_->GetToken();
   lexer_->GetToken();
   SN init = nullptr;
@@ -567,12 +905,15 @@ SN Parser::ParseForStatement()
     update = ParseExpression();
   }
   auto body = ParseStatement();
-  return make_shared<ForStatementNode>(move(init), move(test), move(update),
-                                       move(body));
+  scope_builder_.CloseTo(scope_depth);
+  return NewNode<ForStatementNode>(start, move(init), move(test), move(update),
+                                   move(body));
 }
 
 SN Parser::ParseForInStatementOrForOfStatement()
 {
+  auto start = lexer_->token_start();
+  auto scope_depth = scope_builder_.Open(ScopeKind::kBlock, start);
   lexer_->GetToken();
   bool await = false;
   if (lexer_->current_token() == TokenType::kAwaitToken)
@@ -588,63 +929,76 @@ SN Parser::ParseForInStatementOrForOfStatement()
   }
   else
   {
-    left = ParseExpression();
+    // Not ParseExpression, which would take `in` as a binary operator.
+    left = ParseUnaryExpression();
   }
 
+  SN node;
   switch (lexer_->current_token())
   {
   case TokenType::kInToken:
   {
-    return ParseForInStatement(move(left));
+    node = ParseForInStatement(move(left), start);
+    break;
   }
   case TokenType::kOfToken:
   {
-    return ParseForOfStatement(move(left), await);
+    node = ParseForOfStatement(move(left), await, start);
+    break;
   }
   default:
   {
-    UNREACHABLE;
+    node = Error("Expected 'in' or 'of'");
+    break;
   }
   }
+  scope_builder_.CloseTo(scope_depth);
+  return node;
 }
 
-SN Parser::ParseForInStatement(SN left)
+SN Parser::ParseForInStatement(SN left, size_t start)
 {
   lexer_->GetToken();
   auto right = ParseExpression();
   auto body = ParseStatement();
-  return make_shared<ForInStatementNode>(move(left), move(right), move(body));
+  return NewNode<ForInStatementNode>(start, move(left), move(right),
+                                     move(body));
 }
 
-SN Parser::ParseForOfStatement(SN left,
-                                             bool await)
+SN Parser::ParseForOfStatement(SN left, bool await, size_t start)
 {
   lexer_->GetToken();
   auto right = ParseExpression();
   auto body = ParseStatement();
-  return make_shared<ForOfStatementNode>(move(left), move(right), move(body),
-                                         await);
+  return NewNode<ForOfStatementNode>(start, move(left), move(right), move(body),
+                                     await);
 }
 
 SN Parser::ParseThrowStatement()
 {
+  auto start = lexer_->token_start();
   lexer_->GetToken();
   auto argument = ParseExpression();
-  return make_shared<ThrowStatementNode>(move(argument));
+  return NewNode<ThrowStatementNode>(start, move(argument));
 }
 
 SN Parser::ParseCatchClause()
 {
+  auto start = lexer_->token_start();
+  auto scope_depth = scope_builder_.Open(ScopeKind::kCatch, start);
   lexer_->GetToken();
-  lexer_->GetToken();
+  Expect(TokenType::kLeftParenToken, "Expected '('");
   auto param = ParseIdentifier();
-  lexer_->GetToken();
+  DeclareBinding(param, BindingKind::kCatchParam);
+  Expect(TokenType::kRightParenToken, "Expected ')'");
   auto body = ParseStatement();
-  return make_shared<CatchClauseNode>(move(param), move(body));
+  scope_builder_.CloseTo(scope_depth);
+  return NewNode<CatchClauseNode>(start, move(param), move(body));
 }
 
 SN Parser::ParseTryStatement()
 {
+  auto start = lexer_->token_start();
   lexer_->GetToken();
   auto block = ParseStatement();
   SN handler = nullptr;
@@ -658,29 +1012,32 @@ SN Parser::ParseTryStatement()
     lexer_->GetToken();
     finalizer = ParseStatement();
   }
-  return make_shared<TryStatementNode>(move(block), move(handler),
-                                       move(finalizer));
+  return NewNode<TryStatementNode>(start, move(block), move(handler),
+                                   move(finalizer));
 }
 
-SVSN Parser::ParseFunctionParams()
+NodeList Parser::ParseFunctionParams()
 {
-  lexer_->GetToken();
-  SVSN params = make_shared<VSN>();
-  while (lexer_->current_token() != TokenType::kRightParenToken)
+  Expect(TokenType::kLeftParenToken, "Expected '('");
+  NodeList params;
+  while (lexer_->current_token() != TokenType::kRightParenToken &&
+         lexer_->current_token() != TokenType::kEofToken && !panicking_)
   {
     auto param = ParseIdentifier();
-    params->push_back(move(param));
+    DeclareBinding(param, BindingKind::kParam);
+    params.push_back(move(param));
     if (lexer_->current_token() == TokenType::kCommaToken)
     {
       lexer_->GetToken();
     }
   }
-  lexer_->GetToken();
+  Expect(TokenType::kRightParenToken, "Expected ')'");
   return params;
 }
 
 SN Parser::ParseFunctionDeclaration()
 {
+  auto start = lexer_->token_start();
   bool generator = false;
   bool async = false;
   if (lexer_->current_token() == TokenType::kAsyncToken)
@@ -695,14 +1052,13 @@ SN Parser::ParseFunctionDeclaration()
     lexer_->GetToken();
   }
   auto id = ParseIdentifier();
-  auto params = ParseFunctionParams();
-  auto body = ParseStatement();
-  return make_shared<FunctionDeclarationNode>(move(id), move(params),
-                                              move(body), generator, async);
+  DeclareBinding(id, BindingKind::kFunction);
+  return ParseFunctionRest(start, move(id), generator, async, false);
 }
 
 SN Parser::ParseFunctionExpression()
 {
+  auto start = lexer_->token_start();
   bool generator = false;
   bool async = false;
   if (lexer_->current_token() == TokenType::kAsyncToken)
@@ -721,115 +1077,230 @@ SN Parser::ParseFunctionExpression()
   {
     id = ParseIdentifier();
   }
+  return ParseFunctionRest(start, move(id), generator, async, true);
+}
+
+// Params and body of a function whose id has been parsed. The id of a
+// function expression is only visible inside it, that of a declaration has
+// been declared in the enclosing scope.
+SN Parser::ParseFunctionRest(size_t start, SN id, bool generator, bool async,
+                             bool expression)
+{
+  auto scope_depth = scope_builder_.Open(ScopeKind::kFunction, start);
+  if (expression)
+  {
+    DeclareBinding(id, BindingKind::kFunction);
+  }
   auto params = ParseFunctionParams();
+  if (options_.lazy_functions && !options_.scopes &&
+      lexer_->current_token() == TokenType::kLeftBraceToken)
+  {
+    auto body_start = lexer_->token_start();
+    auto body_end = lexer_->SkipBraces();
+    // The body may be parsed on another thread while this parse still
+    // interns, so from here on interning is locked.
+    if (!atom_cache_)
+    {
+      atom_cache_ = make_unique<AtomCache>(*atoms_, atoms_->intern_mutex());
+    }
+    auto lazy_body = make_shared<LazyFunctionBody>(LazyFunctionBody{
+        source_lexer_, options_, binary_op_precedence_overrides_,
+        diagnostics_, atoms_, static_cast<uint32_t>(body_start),
+        static_cast<uint32_t>(body_end)});
+    scope_builder_.CloseTo(scope_depth);
+    if (expression)
+    {
+      auto node = NewNode<FunctionExpressionNode>(
+          start, move(id), move(params), nullptr, generator, async);
+      node->set_lazy_body(move(lazy_body));
+      return node;
+    }
+    auto node = NewNode<FunctionDeclarationNode>(
+        start, move(id), move(params), nullptr, generator, async);
+    node->set_lazy_body(move(lazy_body));
+    return node;
+  }
   auto body = ParseStatement();
-  return make_shared<FunctionDeclarationNode>(move(id), move(params),
-                                              move(body), generator, async);
+  scope_builder_.CloseTo(scope_depth);
+  if (expression)
+  {
+    return NewNode<FunctionExpressionNode>(start, move(id), move(params),
+                                           move(body), generator, async);
+  }
+  return NewNode<FunctionDeclarationNode>(start, move(id), move(params),
+                                          move(body), generator, async);
+}
+
+unique_ptr<Parser> Parser::NewViewParser(
+    shared_ptr<Lexer> source_lexer, ParserOptions options,
+    shared_ptr<BinaryOpPrecedences> binary_op_precedence_overrides,
+    size_t offset)
+{
+  auto source = source_lexer->source();
+  auto lexer =
+      make_shared<Lexer>(source.data(), source.data() + source.size());
+  auto parser = make_unique<Parser>(lexer, options);
+  parser->source_lexer_ = move(source_lexer);
+  if (binary_op_precedence_overrides)
+  {
+    parser->binary_op_precedence_overrides_ =
+        move(binary_op_precedence_overrides);
+    parser->binary_op_precedences_ =
+        parser->binary_op_precedence_overrides_.get();
+  }
+  lexer->Seek(offset);
+  lexer->GetToken();
+  return parser;
+}
+
+SN ParseLazyFunctionBody(const LazyFunctionBody &body)
+{
+  auto parser = Parser::NewViewParser(body.lexer, body.options,
+                                      body.binary_op_precedence_overrides,
+                                      body.start);
+  parser->diagnostics_ = body.diagnostics;
+  parser->atoms_ = body.atoms;
+  parser->atom_cache_ =
+      make_unique<AtomCache>(*body.atoms, body.atoms->intern_mutex());
+  ArenaScope arena_scope(parser->arena_.get());
+  return parser->ParseBlockStatement();
+}
+
+SN Parser::ParseModuleSpecifier()
+{
+  if (lexer_->current_token() != TokenType::kStringToken)
+  {
+    return Error("Expected module specifier");
+  }
+  return ParseStringLiteral();
 }
 
 SN Parser::ParseImportSpecifier()
 {
-  auto imported = ParseIdentifier();
+  auto start = lexer_->token_start();
+  auto imported = ParseIdentifierName();
   SN local = imported;
   if (lexer_->current_token() == TokenType::kAsToken)
   {
     lexer_->GetToken();
     local = ParseIdentifier();
   }
-  return make_shared<ImportSpecifierNode>(move(imported), move(local));
+  DeclareBinding(local, BindingKind::kImport);
+  return NewNode<ImportSpecifierNode>(start, move(imported), move(local));
 }
 
 SN Parser::ParseImportDefaultSpecifier()
 {
+  auto start = lexer_->token_start();
   auto local = ParseIdentifier();
-  return make_shared<ImportDefaultSpecifierNode>(move(local));
+  DeclareBinding(local, BindingKind::kImport);
+  return NewNode<ImportDefaultSpecifierNode>(start, move(local));
 }
 
 SN Parser::ParseImportNamespaceSpecifier()
 {
+  auto start = lexer_->token_start();
   lexer_->GetToken();
   lexer_->GetToken();
   auto local = ParseIdentifier();
-  return make_shared<ImportNamespaceSpecifierNode>(move(local));
+  DeclareBinding(local, BindingKind::kImport);
+  return NewNode<ImportNamespaceSpecifierNode>(start, move(local));
 }
 
 SN Parser::ParseImportDeclaration()
 {
+  auto start = lexer_->token_start();
   lexer_->GetToken();
-  SVSN specifiers = make_shared<VSN>();
-  while (lexer_->current_token() != TokenType::kFromToken)
+  NodeList specifiers;
+  // `import "x"` has neither specifiers nor `from`.
+  while (lexer_->current_token() != TokenType::kFromToken &&
+         lexer_->current_token() != TokenType::kStringToken && !panicking_)
   {
     if (lexer_->current_token() == TokenType::kMulToken)
     {
       auto specifier = ParseImportNamespaceSpecifier();
-      specifiers->push_back(move(specifier));
+      specifiers.push_back(move(specifier));
     }
     else if (lexer_->current_token() == TokenType::kIdentifierToken)
     {
       auto specifier = ParseImportDefaultSpecifier();
-      specifiers->push_back(move(specifier));
+      specifiers.push_back(move(specifier));
     }
     else if (lexer_->current_token() == TokenType::kLeftBraceToken)
     {
       lexer_->GetToken();
-      while (lexer_->current_token() != TokenType::kRightBraceToken)
+      while (lexer_->current_token() != TokenType::kRightBraceToken &&
+             lexer_->current_token() != TokenType::kEofToken && !panicking_)
       {
         auto specifier = ParseImportSpecifier();
-        specifiers->push_back(move(specifier));
+        specifiers.push_back(move(specifier));
         if (lexer_->current_token() == TokenType::kCommaToken)
         {
           lexer_->GetToken();
         }
       }
+      Expect(TokenType::kRightBraceToken, "Expected '}'");
+    }
+    else
+    {
+      return Error("Unexpected token in import");
     }
     if (lexer_->current_token() == TokenType::kCommaToken)
     {
       lexer_->GetToken();
     }
   }
-  lexer_->GetToken();
-  auto source = ParseStringLiteral();
+  if (lexer_->current_token() == TokenType::kFromToken)
+  {
+    lexer_->GetToken();
+  }
+  auto source = ParseModuleSpecifier();
   SKIP_SEMICOLON;
-  return make_shared<ImportDeclarationNode>(ImportKind::kValue,
-                                            move(specifiers), source);
+  return NewNode<ImportDeclarationNode>(start, ImportKind::kValue,
+                                        move(specifiers), source);
 }
 
 SN Parser::ParseExportSpecifier()
 {
-  auto local = ParseIdentifier();
+  auto start = lexer_->token_start();
+  auto local = ParseIdentifierName();
   SN exported = local;
   if (lexer_->current_token() == TokenType::kAsToken)
   {
     lexer_->GetToken();
-    exported = ParseIdentifier();
+    exported = ParseIdentifierName();
   }
-  return make_shared<ExportSpecifierNode>(move(exported), move(local));
+  return NewNode<ExportSpecifierNode>(start, move(exported), move(local));
 }
 
 SN Parser::ParseExportNamespaceSpecifier()
 {
+  auto start = lexer_->token_start();
   lexer_->GetToken();
-  auto exported = ParseIdentifier();
-  return make_shared<ExportNamespaceSpecifierNode>(move(exported));
+  auto exported = ParseIdentifierName();
+  return NewNode<ExportNamespaceSpecifierNode>(start, move(exported));
 }
 
 SN Parser::ParseExportNamedDeclarationOrExportAllDeclaration()
 {
-  SVSN specifiers = make_shared<VSN>();
+  auto start = lexer_->token_start();
+  NodeList specifiers;
   SN declaration = nullptr;
   SN source = nullptr;
   if (lexer_->current_token() == TokenType::kLeftBraceToken)
   {
     lexer_->GetToken();
-    while (lexer_->current_token() != TokenType::kRightBraceToken)
+    while (lexer_->current_token() != TokenType::kRightBraceToken &&
+           lexer_->current_token() != TokenType::kEofToken && !panicking_)
     {
       auto specifier = ParseExportSpecifier();
-      specifiers->push_back(move(specifier));
+      specifiers.push_back(move(specifier));
       if (lexer_->current_token() == TokenType::kCommaToken)
       {
         lexer_->GetToken();
       }
     }
+    Expect(TokenType::kRightBraceToken, "Expected '}'");
   }
   else if (lexer_->current_token() == TokenType::kMulToken)
   {
@@ -837,13 +1308,14 @@ SN Parser::ParseExportNamedDeclarationOrExportAllDeclaration()
     if (lexer_->current_token() == TokenType::kAsToken)
     {
       auto specifier = ParseExportNamespaceSpecifier();
-      specifiers->push_back(move(specifier));
+      specifiers.push_back(move(specifier));
     }
     else
     {
-      lexer_->GetToken();
-      auto source = ParseIdentifier();
-      return make_shared<ExportAllDeclarationNode>(move(source));
+      Expect(TokenType::kFromToken, "Expected 'from'");
+      auto source = ParseModuleSpecifier();
+      SKIP_SEMICOLON;
+      return NewNode<ExportAllDeclarationNode>(start, move(source));
     }
   }
   else
@@ -853,15 +1325,28 @@ SN Parser::ParseExportNamedDeclarationOrExportAllDeclaration()
   if (lexer_->current_token() == TokenType::kFromToken)
   {
     lexer_->GetToken();
-    source = ParseIdentifier();
+    source = ParseModuleSpecifier();
+  }
+  else
+  {
+    // Without a source the specifiers export bindings of this module.
+    for (const auto &specifier : specifiers)
+    {
+      if (specifier->type() == NodeType::kExportSpecifier)
+      {
+        ReferenceBinding(
+            static_cast<const ExportSpecifierNode &>(*specifier).local());
+      }
+    }
   }
   SKIP_SEMICOLON;
-  return make_shared<ExportNamedDeclarationNode>(
-      move(declaration), move(specifiers), move(source));
+  return NewNode<ExportNamedDeclarationNode>(start, move(declaration),
+                                             move(specifiers), move(source));
 }
 
 SN Parser::ParseExportDefaultDeclaration()
 {
+  auto start = lexer_->token_start();
   lexer_->GetToken();
   SN declaration = nullptr;
   if (lexer_->current_token() == TokenType::kFunctionToken)
@@ -872,7 +1357,7 @@ SN Parser::ParseExportDefaultDeclaration()
   {
     declaration = ParseExpression();
   }
-  return make_shared<ExportDefaultDeclarationNode>(move(declaration));
+  return NewNode<ExportDefaultDeclarationNode>(start, move(declaration));
 }
 
 SN
@@ -911,35 +1396,383 @@ SN Parser::ParseDeclaration()
   {
     return ParseVariableDeclaration();
   }
-  UNREACHABLE;
+  return Error("Expected declaration");
+}
+
+// Records a syntax error at the current token, unless the statement
+// already has one. The caller goes on as if the construct had parsed,
+// Recover then skips what is left of the statement.
+SN Parser::Error(const char *message)
+{
+  // Later errors in the same statement are usually caused by this one.
+  if (!panicking_)
+  {
+    // Every construct still open at the end fails there, the first to say
+    // so is enough.
+    if (lexer_->current_token() != TokenType::kEofToken ||
+        !diagnostics_->LastAt(lexer_->token_start()))
+    {
+      diagnostics_->Add(lexer_->token_start(), message);
+    }
+    panicking_ = true;
+    if (!options_.recover)
+    {
+      UNREACHABLE;
+    }
+  }
+  return NewNode<ErrorNode>(lexer_->token_start());
+}
+
+bool Parser::Expect(TokenType token, const char *message)
+{
+  if (lexer_->current_token() != token)
+  {
+    Error(message);
+    return false;
+  }
+  lexer_->GetToken();
+  return true;
+}
+
+namespace
+{
+
+bool StartsStatement(TokenType token)
+{
+  switch (token)
+  {
+  case TokenType::kFunctionToken:
+  case TokenType::kClassToken:
+  case TokenType::kImportToken:
+  case TokenType::kExportToken:
+  case TokenType::kVarToken:
+  case TokenType::kLetToken:
+  case TokenType::kConstToken:
+  case TokenType::kIfToken:
+  case TokenType::kForToken:
+  case TokenType::kWhileToken:
+  case TokenType::kDoToken:
+  case TokenType::kSwitchToken:
+  case TokenType::kTryToken:
+  case TokenType::kReturnToken:
+  case TokenType::kThrowToken:
+  case TokenType::kBreakToken:
+  case TokenType::kContinueToken:
+  case TokenType::kDebuggerToken:
+  {
+    return true;
+  }
+  default:
+  {
+    return false;
+  }
+  }
+}
+
+} // namespace
+
+// Skips to the next statement boundary: past a `;` or a `}` closing a
+// brace opened on the way, or up to a `}` closing the enclosing block or a
+// keyword starting a statement, outside of any brackets opened on the way.
+void Parser::Synchronize()
+{
+  size_t depth = 0;
+  while (1)
+  {
+    auto token = lexer_->current_token();
+    switch (token)
+    {
+    case TokenType::kEofToken:
+    {
+      return;
+    }
+    case TokenType::kLeftBraceToken:
+    case TokenType::kLeftParenToken:
+    case TokenType::kLeftBracketToken:
+    {
+      depth++;
+      break;
+    }
+    case TokenType::kRightParenToken:
+    case TokenType::kRightBracketToken:
+    {
+      if (depth > 0)
+      {
+        depth--;
+      }
+      break;
+    }
+    case TokenType::kRightBraceToken:
+    {
+      if (depth == 0)
+      {
+        return;
+      }
+      // A block or function body the statement opened ends it.
+      if (--depth == 0)
+      {
+        lexer_->GetToken();
+        return;
+      }
+      break;
+    }
+    case TokenType::kSemiColonToken:
+    {
+      if (depth == 0)
+      {
+        lexer_->GetToken();
+        return;
+      }
+      break;
+    }
+    default:
+    {
+      if (depth == 0 && StartsStatement(token))
+      {
+        return;
+      }
+      break;
+    }
+    }
+    lexer_->GetToken();
+  }
+}
+
+// Runs parse and, if it reported an error, replaces what it returned with
+// an ErrorNode spanning up to the next statement boundary. At least one
+// token is consumed, so a loop calling this always makes progress.
+SN Parser::Recover(SN (Parser::*parse)())
+{
+  auto start = lexer_->token_start();
+  auto panicking = panicking_;
+  auto scope_depth = scope_builder_.depth();
+  panicking_ = false;
+  semicolon_end_ = SIZE_MAX;
+  auto node = (this->*parse)();
+  // Scopes a failed construct left open.
+  scope_builder_.CloseTo(scope_depth);
+  if (!panicking_)
+  {
+    panicking_ = panicking;
+    return node;
+  }
+  panicking_ = panicking;
+  if (lexer_->token_start() == start &&
+      lexer_->current_token() != TokenType::kEofToken)
+  {
+    lexer_->GetToken();
+  }
+  else if (lexer_->token_start() == semicolon_end_)
+  {
+    // It still ran to its `;`, what follows is the next statement.
+    return NewNode<ErrorNode>(start);
+  }
+  Synchronize();
+  return NewNode<ErrorNode>(start);
+}
+
+SN Parser::ParseStatementListItem()
+{
+  return Recover(&Parser::ParseStatement);
+}
+
+SN Parser::ParseModuleItem()
+{
+  if (lexer_->current_token() == TokenType::kImportToken)
+  {
+    return ParseImportDeclaration();
+  }
+  if (lexer_->current_token() == TokenType::kExportToken)
+  {
+    return ParseExportNamedDeclarationOrExportDefaultDeclaration();
+  }
+  return ParseStatement();
+}
+
+// Lists of the statement spill into arena_, which its nodes keep alive.
+SN Parser::ParseTopLevelStatement()
+{
+  ArenaScope arena_scope(arena_.get());
+  return Recover(&Parser::ParseModuleItem);
 }
 
 SN Parser::ParseProgram()
 {
+  auto start = lexer_->token_start();
   SourceType source_type = SourceType::kModule;
-  SVSN body = make_shared<VSN>();
+  NodeList body;
+  BeginScopes();
   while (lexer_->current_token() != TokenType::kEofToken)
   {
-    SN node;
-    if (lexer_->current_token() == TokenType::kImportToken)
-    {
-      node = ParseImportDeclaration();
-    }
-    else if (lexer_->current_token() == TokenType::kExportToken)
+    body.push_back(ParseTopLevelStatement());
+  }
+  scope_builder_.End();
+  return NewNode<ProgramNode>(start, source_type, move(body), atoms_);
+}
+
+namespace
+{
+
+// True if ptr is the only owner, in which case no tree from an earlier
+// parse holds the object and none can start to, so it is safe to reuse in
+// place. use_count alone is a relaxed load, which would not order the
+// reuse after what another thread did through an owner it has since
+// dropped. Copying ptr is a read-modify-write of the count, an acquire in
+// libstdc++, and the fence makes it one where the increment is relaxed.
+template <typename T>
+bool SoleOwner(const shared_ptr<T> &ptr)
+{
+  auto copy = ptr;
+  if (copy.use_count() != 2)
+  {
+    return false;
+  }
+  atomic_thread_fence(memory_order_acquire);
+  return true;
+}
+
+} // namespace
+
+void Parser::Reset(string source, ParserOptions options)
+{
+  options_ = options;
+  source_lexer_.reset();
+  if (SoleOwner(lexer_))
+  {
+    lexer_->Reset(move(source));
+  }
+  else
+  {
+    lexer_ = make_shared<Lexer>(move(source));
+  }
+  source_lexer_ = lexer_;
+  if (options_.arena)
+  {
+    RenewArena();
+  }
+  else
+  {
+    arena_.reset();
+  }
+  if (SoleOwner(diagnostics_))
+  {
+    diagnostics_->diagnostics().clear();
+  }
+  else
+  {
+    diagnostics_ = make_shared<DiagnosticList>();
+  }
+  atom_cache_.reset();
+  if (SoleOwner(atoms_))
+  {
+    atoms_->Clear();
+  }
+  else
+  {
+    atoms_ = make_shared<AtomTable>();
+  }
+  pending_operators_.clear();
+  pending_operands_.clear();
+  panicking_ = false;
+  scope_tree_.reset();
+}
+
+void Parser::RenewArena()
+{
+  if (arena_ && SoleOwner(arena_))
+  {
+    arena_->Reset();
+  }
+  else
+  {
+    arena_ = make_shared<Arena>();
+  }
+}
+
+void Parser::ResetBinaryOpPrecedences()
+{
+  binary_op_precedence_overrides_.reset();
+  binary_op_precedences_ = &kBinaryOpPrecedences;
+}
+
+SN Parser::Parse()
+{
+  if (options_.parse_threads > 1 && !options_.scopes)
+  {
+    ThreadPool pool(options_.parse_threads);
+    if (options_.lex_threads > 1)
     {
-      node = ParseExportNamedDeclarationOrExportAllDeclaration();
+      lexer_->Adopt(ParallelTokenize(lexer_->source(), pool));
     }
     else
     {
-      node = ParseStatement();
+      lexer_->Tokenize();
     }
-    body->push_back(move(node));
+    return ParseProgramParallel(pool);
   }
-  return make_shared<ProgramNode>(source_type, move(body));
+  StartLexing();
+  return ParseProgram();
 }
 
-SN Parser::Parse()
+// Without parse_threads, so the same for Parse and ParseStreaming.
+void Parser::StartLexing()
 {
+  if (options_.pretokenize && options_.lex_threads > 1)
+  {
+    ThreadPool pool(options_.lex_threads);
+    lexer_->Adopt(ParallelTokenize(lexer_->source(), pool));
+  }
+  else if (options_.pretokenize)
+  {
+    lexer_->Tokenize();
+  }
   lexer_->GetToken();
-  return ParseProgram();
-}
\ No newline at end of file
+}
+
+// In arena mode each statement gets its own arena, released with the
+// statement, where Parse puts the whole tree in one.
+void Parser::ParseStreaming(const function<void(SN)> &callback)
+{
+  StartLexing();
+  BeginScopes();
+  while (lexer_->current_token() != TokenType::kEofToken)
+  {
+    if (options_.arena)
+    {
+      RenewArena();
+    }
+    callback(ParseTopLevelStatement());
+  }
+  scope_builder_.End();
+}
+
+void Parser::BeginScopes()
+{
+  if (!options_.scopes)
+  {
+    scope_tree_.reset();
+    return;
+  }
+  scope_tree_ = make_shared<ScopeTree>();
+  scope_builder_.Begin(scope_tree_.get(), lexer_->token_start());
+}
+
+void Parser::DeclareBinding(const SN &id, BindingKind kind)
+{
+  if (scope_builder_.active() && id && id->type() == NodeType::kIdentifier)
+  {
+    scope_builder_.Declare(static_cast<const IdentifierNode &>(*id).atom(),
+                           kind, id->start());
+  }
+}
+
+void Parser::ReferenceBinding(const SN &identifier)
+{
+  if (scope_builder_.active() && identifier &&
+      identifier->type() == NodeType::kIdentifier)
+  {
+    scope_builder_.Reference(
+        static_cast<const IdentifierNode &>(*identifier).atom(),
+        identifier->start());
+  }
+}
@@ -1,12 +1,21 @@
+#pragma once
+#include "arena.hpp"
+#include "atom.hpp"
 #include "lexer.hpp"
+#include "node_list.hpp"
+#include "number.hpp"
+#include "scope.hpp"
+#include "util.hpp"
 #include "visitor.hpp"
 #include <algorithm>
 #include <fmt/core.h>
 #include <fmt/format.h>
+#include <functional>
 #include <iterator>
 #include <locale>
 #include <map>
 #include <memory>
+#include <mutex>
 #include <new>
 #include <ostream>
 #include <pthread.h>
@@ -20,8 +29,6 @@ using namespace std;
 // #include <magic_enum.hpp>
 
 #define SN shared_ptr<Node>
-#define VSN vector<SN>
-#define SVSN shared_ptr<VSN>
 
 
 enum class NodeType {
@@ -66,11 +73,14 @@ enum class NodeType {
   kExportDefaultDeclaration,
   kExportAllDeclaration,
   kCallExpression,
-  kParenthesizedExpression
+  kParenthesizedExpression,
+  kError,
+  kNodeTypeCount
 };
 
 class Node : public std::enable_shared_from_this<Node> {
   NodeType type_;
+  uint32_t start_ = 0;
 
 public:
   Node(NodeType type) : type_(type) {}
@@ -83,14 +93,27 @@ public:
 
   NodeType type() const { return type_; }
 
+  // Byte offset of the node in its source, Parser::GetPosition maps it to
+  // a line and column.
+  uint32_t start() const { return start_; }
+  void set_start(uint32_t start) { start_ = start; }
+
   virtual string GenJs() const { return ""; };
 
   virtual void Accept(Visitor &visitor) {}
 
-  static auto GenJsForVector(const SVSN &body,
+  // Copy of the node sharing its children.
+  virtual SN Clone() const { return make_shared<Node>(*this); }
+
+  // Drops child. Nodes that can nest without bound release their children
+  // here from their destructors, so a deep tree is freed by a loop instead
+  // of one stack frame per level.
+  static void Release(SN &child);
+
+  static auto GenJsForVector(const NodeList &body,
                              string delim = "\n", string prefix = "") {
     vector<string> body_str;
-    transform(body->begin(), body->end(), back_inserter(body_str),
+    transform(body.begin(), body.end(), back_inserter(body_str),
               [prefix](SN node) {
                 return fmt::format("{}{}", prefix, node->GenJs());
               });
@@ -102,18 +125,31 @@ public:
   void Accept(Visitor &visitor) override {                                     \
     auto node = dynamic_pointer_cast<V>(shared_from_this());                   \
     visitor.visit##V(move(node));                                              \
-  }
+  }                                                                            \
+  SN Clone() const override { return make_shared<V>(*this); }
 
 class IdentifierNode : public Node {
-  string name_;
+  // Table name_ is an atom of, which the tree keeps alive, see AtomTable.
+  AtomTable *table_;
+  Atom name_;
 
 public:
-  IdentifierNode(string name) : Node(NodeType::kIdentifier), name_(name) {}
-  string GenJs() const override { return name_; }
-
-  string name() const { return name_; }
-
-  void set_name(const string& name) { name_ = name; }
+  // Interns name into AtomTable::Global().
+  IdentifierNode(string name)
+      : Node(NodeType::kIdentifier), table_(&AtomTable::Global()),
+        name_(table_->InternShared(name)) {}
+  IdentifierNode(Atom name, AtomTable *table)
+      : Node(NodeType::kIdentifier), table_(table), name_(name) {}
+  string GenJs() const override { return name(); }
+
+  string name() const { return table_->name(name_); }
+
+  // Equal atoms mean equal names only between nodes of one table.
+  Atom atom() const { return name_; }
+  AtomTable *table() const { return table_; }
+
+  // Interns name into the table of the node.
+  void set_name(const string &name) { name_ = table_->InternShared(name); }
   NA(IdentifierNode);
 };
 
@@ -126,16 +162,23 @@ public:
 
 class StringLiteralNode : public Node {
   string value_;
+  char quote_;
 
 public:
-  StringLiteralNode(string value)
-      : Node(NodeType::kStringLiteral), value_(value) {}
+  // value is the body as written, escapes included. GenJs puts it back
+  // between the quote it was written with, so it stays valid.
+  StringLiteralNode(string value, char quote = '"')
+      : Node(NodeType::kStringLiteral), value_(value), quote_(quote) {}
   string value() const { return value_; }
-  string GenJs() const override { return fmt::format("\"{}\"", value_); }
+  char quote() const { return quote_; }
+  string GenJs() const override {
+    return fmt::format("{0}{1}{0}", quote_, value_);
+  }
 
   NA(StringLiteralNode);
 
   void set_value(const string& value) { value_ = value; }
+  void set_quote(const char& quote) { quote_ = quote; }
 };
 
 class BooleanLiteralNode : public Node {
@@ -159,41 +202,90 @@ public:
 
 class NumericLiteralNode : public Node {
   double value_;
+  bool bigint_;
+  // Of a parsed BigInt, its source text without the `n`. value_ is only
+  // the nearest double, which loses digits above 2^53.
+  string digits_;
 
 public:
-  NumericLiteralNode(double value)
-      : Node(NodeType::kNumericLiteral), value_(value) {}
+  NumericLiteralNode(double value, bool bigint = false)
+      : Node(NodeType::kNumericLiteral), value_(value), bigint_(bigint) {}
+  NumericLiteralNode(double value, string digits)
+      : Node(NodeType::kNumericLiteral), value_(value), bigint_(true),
+        digits_(move(digits)) {}
   double value() const { return value_; }
-  string GenJs() const override { return to_string(value_); }
+  bool bigint() const { return bigint_; }
+  const string &digits() const { return digits_; }
+  string GenJs() const override {
+    if (bigint_) {
+      return digits_.empty() ? fmt::format("{:.0f}n", value_) : digits_ + "n";
+    }
+    return to_string(value_);
+  }
   NA(NumericLiteralNode);
-  void set_value(const double& value) { value_ = value; }
+  void set_value(const double& value) {
+    value_ = value;
+    digits_.clear();
+  }
+  void set_bigint(const bool& bigint) {
+    bigint_ = bigint;
+    digits_.clear();
+  }
 };
 
+#define UNARY_OPERATORS(V)                                                     \
+  V(Sub, "-")                                                                  \
+  V(Add, "+")                                                                  \
+  V(Excla, "!")                                                                \
+  V(Neg, "~")                                                                  \
+  V(TypeOf, "typeof")                                                          \
+  V(Void, "void")                                                              \
+  V(Delete, "delete")                                                          \
+  V(Throw, "throw")
+
+#define OPERATOR_KIND(N, S) k##N,
+#define OPERATOR_SOURCE(N, S) S,
+
+enum class UnaryOperatorKind : uint8_t { UNARY_OPERATORS(OPERATOR_KIND) };
+
+inline constexpr const char *kUnaryOperatorSources[] = {
+    UNARY_OPERATORS(OPERATOR_SOURCE)};
+
+// One byte, the source text lives in kUnaryOperatorSources.
 class UnaryOperator {
-  string source_;
+  UnaryOperatorKind kind_;
 
 public:
-  UnaryOperator(string source) : source_(source) {}
-  string GenJs() const { return source_; }
-  string source() const { return source_; }
-  const static UnaryOperator kSubOp;
-  const static UnaryOperator kAddOp;
-  const static UnaryOperator kExclaOp;
-  const static UnaryOperator kNegOp;
-  const static UnaryOperator kTypeOfOp;
-  const static UnaryOperator kVoidOp;
-  const static UnaryOperator kDeleteOp;
-  const static UnaryOperator kThrowOp;
+  constexpr UnaryOperator(UnaryOperatorKind kind) : kind_(kind) {}
+  UnaryOperator(const string &source) : kind_(UnaryOperatorKind::kSub) {
+    for (size_t i = 0; i < size(kUnaryOperatorSources); i++) {
+      if (source == kUnaryOperatorSources[i]) {
+        kind_ = static_cast<UnaryOperatorKind>(i);
+        return;
+      }
+    }
+    UNREACHABLE;
+  }
+  UnaryOperatorKind kind() const { return kind_; }
+  string GenJs() const { return source(); }
+  string source() const {
+    return kUnaryOperatorSources[static_cast<size_t>(kind_)];
+  }
+  bool operator==(const UnaryOperator &rhs) const {
+    return kind_ == rhs.kind_;
+  }
+  bool operator!=(const UnaryOperator &rhs) const {
+    return kind_ != rhs.kind_;
+  }
+#define OPERATOR_CONSTANT(N, S) const static UnaryOperator k##N##Op;
+  UNARY_OPERATORS(OPERATOR_CONSTANT)
+#undef OPERATOR_CONSTANT
 };
 
-inline const UnaryOperator UnaryOperator::kSubOp = {"-"};
-inline const UnaryOperator UnaryOperator::kAddOp = {"+"};
-inline const UnaryOperator UnaryOperator::kExclaOp = {"!"};
-inline const UnaryOperator UnaryOperator::kNegOp = {"~"};
-inline const UnaryOperator UnaryOperator::kTypeOfOp = {"typeof"};
-inline const UnaryOperator UnaryOperator::kVoidOp = {"void"};
-inline const UnaryOperator UnaryOperator::kDeleteOp = {"delete"};
-inline const UnaryOperator UnaryOperator::kThrowOp = {"throw"};
+#define OPERATOR_CONSTANT(N, S)                                                \
+  inline const UnaryOperator UnaryOperator::k##N##Op{UnaryOperatorKind::k##N};
+UNARY_OPERATORS(OPERATOR_CONSTANT)
+#undef OPERATOR_CONSTANT
 
 class UnaryExpressionNode : public Node {
   UnaryOperator op_;
@@ -202,6 +294,7 @@ class UnaryExpressionNode : public Node {
 public:
   UnaryExpressionNode(UnaryOperator op, SN argument)
       : Node(NodeType::kUnaryExpression), op_(op), argument_(move(argument)) {}
+  ~UnaryExpressionNode() override { Release(argument_); }
 
   UnaryOperator op() const { return op_; }
   SN argument() const { return argument_; }
@@ -218,53 +311,83 @@ public:
   NA(UnaryExpressionNode);
 };
 
+#define BINARY_OPERATORS(V)                                                    \
+  V(EqualEqual, "==")                                                          \
+  V(NotEqual, "!=")                                                            \
+  V(EqualEqualEqual, "===")                                                    \
+  V(NotEqualEqual, "!==")                                                      \
+  V(LessThan, "<")                                                             \
+  V(LessEqual, "<=")                                                           \
+  V(GreaterThan, ">")                                                          \
+  V(GreaterEqual, ">=")                                                        \
+  V(LessLess, "<<")                                                            \
+  V(GreaterGreater, ">>")                                                      \
+  V(GreaterGreaterGreater, ">>>")                                              \
+  V(Add, "+")                                                                  \
+  V(Sub, "-")                                                                  \
+  V(Mul, "*")                                                                  \
+  V(Div, "/")                                                                  \
+  V(Mod, "%")                                                                  \
+  V(Exp, "**")                                                                 \
+  V(BitAnd, "&")                                                               \
+  V(BitOr, "|")                                                                \
+  V(BitXor, "^")                                                               \
+  V(And, "&&")                                                                 \
+  V(Or, "||")                                                                  \
+  V(Nullish, "??")                                                             \
+  V(In, "in")                                                                  \
+  V(InstanceOf, "instanceof")
+
+enum class BinaryOperatorKind : uint8_t { BINARY_OPERATORS(OPERATOR_KIND) };
+
+inline constexpr const char *kBinaryOperatorSources[] = {
+    BINARY_OPERATORS(OPERATOR_SOURCE)};
+
+// One byte, the source text lives in kBinaryOperatorSources.
 class BinaryOperator {
-  string source_;
+  BinaryOperatorKind kind_;
 
 public:
-  BinaryOperator(string source) : source_(source) {}
+  constexpr BinaryOperator(BinaryOperatorKind kind) : kind_(kind) {}
+  BinaryOperator(const string &source) : kind_(BinaryOperatorKind::kAdd) {
+    for (size_t i = 0; i < size(kBinaryOperatorSources); i++) {
+      if (source == kBinaryOperatorSources[i]) {
+        kind_ = static_cast<BinaryOperatorKind>(i);
+        return;
+      }
+    }
+    UNREACHABLE;
+  }
 
 public:
-  string GenJs() const { return source_; }
+  BinaryOperatorKind kind() const { return kind_; }
+  string GenJs() const { return source(); }
   bool operator<(const BinaryOperator &rhs) const {
-    return source_ < rhs.source_;
-  }
-  string source() const { return source_; }
-
-  const static BinaryOperator kEqualEqualOp;
-  const static BinaryOperator kNotEqualOp;
-  const static BinaryOperator kEqualEqualEqualOp;
-  const static BinaryOperator kNotEqualEqualOp;
-  const static BinaryOperator kLessThanOp;
-  const static BinaryOperator kLessEqualOp;
-  const static BinaryOperator kGreaterThanOp;
-  const static BinaryOperator kGreaterEqualOp;
-  const static BinaryOperator kLessLessOp;
-  const static BinaryOperator kGreaterGreaterOp;
-  const static BinaryOperator kGreaterGreaterGreaterOp;
-  const static BinaryOperator kAddOp;
-  const static BinaryOperator kSubOp;
-  const static BinaryOperator kMulOp;
-  const static BinaryOperator kDivOp;
-  const static BinaryOperator kModOp;
+    return kind_ < rhs.kind_;
+  }
+  bool operator==(const BinaryOperator &rhs) const {
+    return kind_ == rhs.kind_;
+  }
+  bool operator!=(const BinaryOperator &rhs) const {
+    return kind_ != rhs.kind_;
+  }
+  string source() const {
+    return kBinaryOperatorSources[static_cast<size_t>(kind_)];
+  }
+
+#define OPERATOR_CONSTANT(N, S) const static BinaryOperator k##N##Op;
+  BINARY_OPERATORS(OPERATOR_CONSTANT)
+#undef OPERATOR_CONSTANT
 };
 
-inline const BinaryOperator BinaryOperator::kEqualEqualOp{"=="};
-inline const BinaryOperator BinaryOperator::kNotEqualOp{"!="};
-inline const BinaryOperator BinaryOperator::kEqualEqualEqualOp{"==="};
-inline const BinaryOperator BinaryOperator::kNotEqualEqualOp{"!=="};
-inline const BinaryOperator BinaryOperator::kLessThanOp{"<"};
-inline const BinaryOperator BinaryOperator::kLessEqualOp{"<="};
-inline const BinaryOperator BinaryOperator::kGreaterThanOp{">"};
-inline const BinaryOperator BinaryOperator::kGreaterEqualOp{">="};
-inline const BinaryOperator BinaryOperator::kLessLessOp{"<<"};
-inline const BinaryOperator BinaryOperator::kGreaterGreaterOp{">>"};
-inline const BinaryOperator BinaryOperator::kGreaterGreaterGreaterOp{">>>"};
-inline const BinaryOperator BinaryOperator::kAddOp{"+"};
-inline const BinaryOperator BinaryOperator::kSubOp{"-"};
-inline const BinaryOperator BinaryOperator::kMulOp{"*"};
-inline const BinaryOperator BinaryOperator::kDivOp{"/"};
-inline const BinaryOperator BinaryOperator::kModOp{"%"};
+#define OPERATOR_CONSTANT(N, S)                                                \
+  inline const BinaryOperator BinaryOperator::k##N##Op{                        \
+      BinaryOperatorKind::k##N};
+BINARY_OPERATORS(OPERATOR_CONSTANT)
+#undef OPERATOR_CONSTANT
+
+#undef OPERATOR_KIND
+#undef OPERATOR_SOURCE
 
 /*
 interface BinaryExpression <: Expression {
@@ -284,6 +407,10 @@ public:
                        SN right)
       : Node(NodeType::kBinaryExpression), op_(op), left_(move(left)),
         right_(move(right)) {}
+  ~BinaryExpressionNode() override {
+    Release(left_);
+    Release(right_);
+  }
   SN left() const { return left_; }
   SN right() const { return right_; }
   BinaryOperator op() const { return op_; }
@@ -312,18 +439,23 @@ public:
 };
 
 class BlockStatementNode : public Node {
-  SVSN body_;
+  NodeList body_;
 
 public:
-  BlockStatementNode(SVSN body)
+  BlockStatementNode(NodeList body)
       : Node(NodeType::kBlockStatement), body_(move(body)) {}
-  SVSN body() const { return body_; }
+  ~BlockStatementNode() override {
+    for (auto &statement : body_) {
+      Release(statement);
+    }
+  }
+  const NodeList &body() const { return body_; }
   string GenJs() const override {
     auto body_str = GenJsForVector(body_, "\n", "\t");
     return fmt::format("{{\n {} \n}}", body_str);
   }
   NA(BlockStatementNode);
-  void set_body(const SVSN& body) { body_ = body; }
+  void set_body(const NodeList &body) { body_ = body; }
 };
 
 class DebuggerStatementNode : public Node {
@@ -349,6 +481,9 @@ public:
       : Node(NodeType::kReturnStatement), argument_(move(argument)) {}
   SN argument() const { return argument_; }
   string GenJs() const override {
+    if (!argument_) {
+      return "return";
+    }
     auto argument_str = argument_->GenJs();
     return fmt::format("return {}", argument_str);
   }
@@ -393,6 +528,9 @@ public:
   string GenJs() const override {
     auto test_str = test_->GenJs();
     auto consequent_str = consequent_->GenJs();
+    if (!alternate_) {
+      return fmt::format("if ({}) {}", test_str, consequent_str);
+    }
     auto alternate_str = alternate_->GenJs();
     return fmt::format("if ({}) {} else {}", test_str, consequent_str,
                        alternate_str);
@@ -403,23 +541,23 @@ public:
 
 class SwitchStatementNode : public Node {
   SN discriminant_;
-  SVSN cases_;
+  NodeList cases_;
 
 public:
   SwitchStatementNode(SN discriminant,
-                      SVSN cases)
+                      NodeList cases)
       : Node(NodeType::kSwitchStatement), discriminant_(move(discriminant)),
         cases_(move(cases)) {}
-  SVSN cases() const { return cases_; }
+  const NodeList &cases() const { return cases_; }
   SN discriminant() const { return discriminant_; }
   void set_discriminant(const SN discriminant) {
     discriminant_ = discriminant;
   }
-  void set_cases(const SVSN& cases) { cases_ = cases; }
+  void set_cases(const NodeList &cases) { cases_ = cases; }
   string GenJs() const override {
     auto discriminant_str = discriminant_->GenJs();
     vector<string> cases_str;
-    transform(cases_->begin(), cases_->end(), back_inserter(cases_str),
+    transform(cases_.begin(), cases_.end(), back_inserter(cases_str),
               [](SN node) { return node->GenJs(); });
     return fmt::format("switch ({}) {{\n {} \n}}", discriminant_str,
                        fmt::join(cases_str, "\n"));
@@ -429,25 +567,28 @@ public:
 
 class SwitchCaseNode : public Node {
   SN test_;
-  SVSN consequent_;
+  NodeList consequent_;
 
 public:
-  SwitchCaseNode(SN test, SVSN consequent)
+  SwitchCaseNode(SN test, NodeList consequent)
       : Node(NodeType::kSwitchCase), test_(move(test)),
         consequent_(move(consequent)) {}
   SN test() const { return test_; }
-  SVSN consequent() const { return consequent_; }
+  const NodeList &consequent() const { return consequent_; }
 
   void set_test(const SN& test) { test_ = test; }
 
-  void set_consequent(const SVSN& consequent) {
+  void set_consequent(const NodeList &consequent) {
     consequent_ = consequent;
   }
 
   string GenJs() const override {
-    auto test_str = test_->GenJs();
     auto consequent_str = GenJsForVector(consequent_);
-    return fmt::format("case ({}): {{\n {} \n}}", consequent_str);
+    if (!test_) {
+      return fmt::format("default: {{\n {} \n}}", consequent_str);
+    }
+    auto test_str = test_->GenJs();
+    return fmt::format("case ({}): {{\n {} \n}}", test_str, consequent_str);
   }
   NA(SwitchCaseNode);
 };
@@ -511,9 +652,9 @@ public:
   void set_update(const SN& update) { update_ = update; }
   void set_body(const SN& body) { body_ = body; }
   string GenJs() const override {
-    auto init_str = init_->GenJs();
-    auto test_str = test_->GenJs();
-    auto update_str = update_->GenJs();
+    auto init_str = init_ ? init_->GenJs() : "";
+    auto test_str = test_ ? test_->GenJs() : "";
+    auto update_str = update_ ? update_->GenJs() : "";
     auto body_str = body_->GenJs();
     return fmt::format("for ({};{};{}) {}", init_str, test_str, update_str,
                        body_str);
@@ -549,6 +690,9 @@ public:
   SN init() const { return init_; }
   string GenJs() const override {
     auto id_str = id_->GenJs();
+    if (!init_) {
+      return id_str;
+    }
     auto init_str = init_->GenJs();
     return fmt::format("{} = {}", id_str, init_str);
   }
@@ -559,17 +703,17 @@ public:
 
 class VariableDeclarationNode : public Node {
   VariableDeclarationKind kind_;
-  SVSN declarations_;
+  NodeList declarations_;
 
 public:
   VariableDeclarationNode(VariableDeclarationKind kind,
-                          SVSN declarations)
+                          NodeList declarations)
       : Node(NodeType::kVariableDeclaration), kind_(kind),
         declarations_(move(declarations)) {}
   VariableDeclarationKind kind() const { return kind_; }
-  SVSN declarations() const { return declarations_; }
+  const NodeList &declarations() const { return declarations_; }
   void set_kind(const VariableDeclarationKind& kind) { kind_ = kind; }
-  void set_declarations(const SVSN& declarations) {
+  void set_declarations(const NodeList &declarations) {
     declarations_ = declarations;
   }
   string GenJs() const override {
@@ -689,7 +833,10 @@ public:
   SN finalizer() const { return finalizer_; }
   string GenJs() const override {
     auto block_str = block_->GenJs();
-    auto handler_str = handler_->GenJs();
+    auto handler_str = handler_ ? handler_->GenJs() : "";
+    if (!finalizer_) {
+      return fmt::format("try {} {}", block_str, handler_str);
+    }
     auto finalizer_str = finalizer_->GenJs();
     return fmt::format("try {} {} finally {}", block_str, handler_str,
                        finalizer_str);
@@ -706,32 +853,73 @@ public:
   NA(TryStatementNode);
 };
 
+struct LazyFunctionBody;
+
+// Parses a body that ParserOptions::lazy_functions skipped.
+SN ParseLazyFunctionBody(const LazyFunctionBody &body);
+
+// Body of a function node. With a lazy body, body_ stays null until get()
+// first parses it. Bodies of different functions may be parsed on
+// different threads, but one unparsed body must not be got from several
+// threads at once.
+class FunctionBody {
+  mutable SN body_;
+  mutable shared_ptr<LazyFunctionBody> lazy_;
+
+public:
+  FunctionBody(SN body) : body_(move(body)) {}
+  SN get() const {
+    if (lazy_) {
+      body_ = ParseLazyFunctionBody(*lazy_);
+      lazy_ = nullptr;
+    }
+    return body_;
+  }
+  bool parsed() const { return !lazy_; }
+  void set(SN body) {
+    body_ = move(body);
+    lazy_ = nullptr;
+  }
+  const shared_ptr<LazyFunctionBody> &lazy() const { return lazy_; }
+  void set_lazy(shared_ptr<LazyFunctionBody> lazy) {
+    body_ = nullptr;
+    lazy_ = move(lazy);
+  }
+};
+
 class FunctionDeclarationNode : public Node {
   SN id_;
-  SVSN params_;
-  SN body_;
+  NodeList params_;
+  FunctionBody body_;
   bool generator_;
   bool async_;
 
 public:
-  FunctionDeclarationNode(SN id, SVSN params,
+  FunctionDeclarationNode(SN id, NodeList params,
                           SN body, bool generator, bool async)
       : Node(NodeType::kFunctionDeclaration), id_(move(id)),
         params_(move(params)), body_(move(body)), generator_(generator),
         async_(async) {}
   SN id() const { return id_; }
-  SVSN params() const { return params_; }
-  SN body() const { return body_; }
+  const NodeList &params() const { return params_; }
+  SN body() const { return body_.get(); }
+  bool body_parsed() const { return body_.parsed(); }
   bool generator() const { return generator_; }
   bool async() const { return async_; }
   void set_id(const SN& id){
     id_ = id;
   }
-  void set_params(const SVSN& params){
+  void set_params(const NodeList &params){
     params_ = params;
   }
   void set_body(const SN& body){
-    body_ = body;
+    body_.set(body);
+  }
+  const shared_ptr<LazyFunctionBody> &lazy_body() const {
+    return body_.lazy();
+  }
+  void set_lazy_body(shared_ptr<LazyFunctionBody> lazy_body) {
+    body_.set_lazy(move(lazy_body));
   }
   void set_generator(const bool& generator){
     generator_ = generator;
@@ -742,7 +930,7 @@ public:
   string GenJs() const override {
     auto id_str = id_->GenJs();
     auto params_str = GenJsForVector(params_, " ");
-    auto body_str = body_->GenJs();
+    auto body_str = body()->GenJs();
     auto generator_str = generator_ ? "*" : "";
     auto async_str = async_ ? "async " : "";
     return fmt::format("{}function{} {}({}) {}", async_str, generator_str,
@@ -753,30 +941,37 @@ public:
 
 class FunctionExpressionNode : public Node {
   SN id_;
-  SVSN params_;
-  SN body_;
+  NodeList params_;
+  FunctionBody body_;
   bool generator_;
   bool async_;
 
 public:
-  FunctionExpressionNode(SN id, SVSN params,
+  FunctionExpressionNode(SN id, NodeList params,
                          SN body, bool generator, bool async)
       : Node(NodeType::kFunctionExpression), id_(move(id)),
         params_(move(params)), body_(move(body)), generator_(generator),
         async_(async) {}
   SN id() const { return id_; }
-  SVSN params() const { return params_; }
-  SN body() const { return body_; }
+  const NodeList &params() const { return params_; }
+  SN body() const { return body_.get(); }
+  bool body_parsed() const { return body_.parsed(); }
   bool generator() const { return generator_; }
   bool async() const { return async_; }
   void set_id(const SN& id){
     id_ = id;
   }
-  void set_params(const SVSN& params){
+  void set_params(const NodeList &params){
     params_ = params;
   }
   void set_body(const SN& body){
-    body_ = body;
+    body_.set(body);
+  }
+  const shared_ptr<LazyFunctionBody> &lazy_body() const {
+    return body_.lazy();
+  }
+  void set_lazy_body(shared_ptr<LazyFunctionBody> lazy_body) {
+    body_.set_lazy(move(lazy_body));
   }
   void set_generator(const bool& generator){
     generator_ = generator;
@@ -785,12 +980,12 @@ public:
     async_  =async;
   }
   string GenJs() const override {
-    auto id_str = id_->GenJs();
+    auto id_str = id_ ? id_->GenJs() : "";
     auto params_str = GenJsForVector(params_, " ");
-    auto body_str = body_->GenJs();
+    auto body_str = body()->GenJs();
     auto generator_str = generator_ ? "*" : "";
     auto async_str = async_ ? "async " : "";
-    return fmt::format("{} function{} {}{} {}", async_str, generator_str,
+    return fmt::format("{}function{} {}({}) {}", async_str, generator_str,
                        id_str, params_str, body_str);
   }
   NA(FunctionExpressionNode);
@@ -802,6 +997,8 @@ class SourceType {
 public:
   SourceType(string source) : source_(source) {}
 
+  string GenJs() const { return source_; }
+
   const static SourceType kModule;
   const static SourceType kScript;
 };
@@ -811,14 +1008,19 @@ inline const SourceType SourceType::kScript("script");
 
 class ProgramNode : public Node {
   SourceType source_type_;
-  SVSN body_;
+  NodeList body_;
+  // Table the identifiers of the tree are interned in, nullptr for a tree
+  // built by hand, whose names are in AtomTable::Global().
+  shared_ptr<AtomTable> atoms_;
 
 public:
-  ProgramNode(SourceType source_type, SVSN body)
-      : Node(NodeType::kProgram), source_type_(source_type), body_(move(body)) {
-  }
+  ProgramNode(SourceType source_type, NodeList body,
+              shared_ptr<AtomTable> atoms = nullptr)
+      : Node(NodeType::kProgram), source_type_(source_type), body_(move(body)),
+        atoms_(move(atoms)) {}
   SourceType source_type() const { return source_type_; }
-  SVSN body() const { return body_; }
+  const NodeList &body() const { return body_; }
+  const shared_ptr<AtomTable> &atoms() const { return atoms_; }
   string GenJs() const override {
     auto body_str = GenJsForVector(body_);
     return fmt::format("{}", body_str);
@@ -826,7 +1028,7 @@ public:
   void set_source_type(const SourceType& source_type){
     source_type_ = source_type;
   }
-  void set_body(const SVSN body){
+  void set_body(const NodeList &body){
     body_ = body;
   }
   NA(ProgramNode);
@@ -853,23 +1055,23 @@ inline const ImportKind ImportKind::kNull("null");
 
 class ImportDeclarationNode : public Node {
   ImportKind import_kind_;
-  SVSN specifiers_;
+  NodeList specifiers_;
   SN source_;
 
 public:
   ImportDeclarationNode(ImportKind import_kind,
-                        SVSN specifiers,
+                        NodeList specifiers,
                         SN source)
       : Node(NodeType::kImportDeclaration), import_kind_(import_kind),
         specifiers_(move(specifiers)), source_(move(source)) {}
   ImportKind import_kind() const { return import_kind_; }
-  SVSN specifiers() const { return specifiers_; }
+  const NodeList &specifiers() const { return specifiers_; }
   SN source() const { return source_; }
 
   void set_import_kind(const ImportKind& import_kind){
     import_kind_ = import_kind;
   }
-  void set_specifiers(const SVSN& specifiers){
+  void set_specifiers(const NodeList &specifiers){
     specifiers_ = specifiers;
   }
   void set_source(const SN& source){
@@ -879,6 +1081,9 @@ public:
     auto import_kind_str = import_kind_.GenJs();
     auto specifiers = GenJsForVector(specifiers_, ",");
     auto source_str = source_->GenJs();
+    if (specifiers_.empty()) {
+      return fmt::format("import {}", source_str);
+    }
     return fmt::format("import {} from {}", specifiers, source_str);
   }
   NA(ImportDeclarationNode);
@@ -1015,26 +1220,26 @@ public:
 
 class ExportNamedDeclarationNode : public Node {
   SN declaration_;
-  SVSN specifiers_;
+  NodeList specifiers_;
   SN source_;
 
 public:
   ExportNamedDeclarationNode(SN declaration,
-                             SVSN specifiers,
+                             NodeList specifiers,
                              SN source)
       : Node(NodeType::kExportNamedDeclaration),
         declaration_(move(declaration)), specifiers_(move(specifiers)),
         source_(move(source)) {}
   SN declaration() const { return declaration_; }
   SN source() const { return source_; }
-  SVSN specifiers() const { return specifiers_; }
+  const NodeList &specifiers() const { return specifiers_; }
   void set_declaration(const SN& declaration){
     declaration_ = declaration;
   }
   void set_source(const SN& source){
     source_ = source;
   }
-  void set_specifiers(const SVSN& specifiers){
+  void set_specifiers(const NodeList &specifiers){
     specifiers_ = specifiers;
   }
   string GenJs() const override {
@@ -1089,15 +1294,15 @@ public:
 };
 
 class CallExpressionNode : public Node {
-  SVSN arguments_;
+  NodeList arguments_;
   SN callee_;
 
 public:
   CallExpressionNode(SN callee,
-                     SVSN arguments)
+                     NodeList arguments)
       : Node(NodeType::kCallExpression), callee_(callee),
         arguments_(move(arguments)) {}
-  SVSN arguments() const { return arguments_; }
+  const NodeList &arguments() const { return arguments_; }
   SN callee() const { return callee_; }
   string GenJs() const override {
     auto callee_str = callee_->GenJs();
@@ -1105,7 +1310,7 @@ public:
     return fmt::format("{}({})", callee_str, arguments_str);
   }
   NA(CallExpressionNode);
-  void set_arguments(const SVSN& arguments){
+  void set_arguments(const NodeList &arguments){
     arguments_ = arguments;
   }
   void set_callee(const SN& callee){
@@ -1120,6 +1325,7 @@ public:
   ParenthesizedExpressionNode(SN expression)
       : Node(NodeType::kParenthesizedExpression),
         expression_(move(expression)) {}
+  ~ParenthesizedExpressionNode() override { Release(expression_); }
   SN expression() const { return expression_; }
   string GenJs() const override {
     auto expression_str = expression_->GenJs();
@@ -1131,32 +1337,282 @@ public:
   }
 };
 
+// Stands in for a statement or expression that failed to parse, see
+// Parser::diagnostics.
+class ErrorNode : public Node {
+public:
+  ErrorNode() : Node(NodeType::kError) {}
+  string GenJs() const override { return ""; }
+  NA(ErrorNode);
+};
+
 #undef NA
 
-class Parser {
-  shared_ptr<Lexer> lexer_;
-  map<BinaryOperator, int> binary_op_precedences_;
+struct Diagnostic {
+  // Byte offset of the offending token.
+  uint32_t offset;
+  string message;
+};
 
-  map<BinaryOperator, int> kDefaultBinaryOpPrecedences = {
-      {BinaryOperator::kLessThanOp, 5}, {BinaryOperator::kLessLessOp, 5},
-      {BinaryOperator::kAddOp, 10},     {BinaryOperator::kSubOp, 10},
-      {BinaryOperator::kMulOp, 20},     {BinaryOperator::kDivOp, 20},
-  };
+// Syntax errors of one tree. The ranges of a parallel parse and the lazy
+// bodies of the tree all report here, so appends are locked.
+class DiagnosticList {
+  mutex mutex_;
+  vector<Diagnostic> diagnostics_;
 
 public:
-  Parser(shared_ptr<Lexer> lexer) : lexer_(move(lexer)) {
-    InstallBinaryOpPrecedences(kDefaultBinaryOpPrecedences);
+  void Add(size_t offset, string message) {
+    lock_guard<mutex> lock(mutex_);
+    diagnostics_.push_back({static_cast<uint32_t>(offset), move(message)});
+  }
+  size_t size() {
+    lock_guard<mutex> lock(mutex_);
+    return diagnostics_.size();
   }
+  // Whether the last diagnostic added is at offset.
+  bool LastAt(size_t offset) {
+    lock_guard<mutex> lock(mutex_);
+    return !diagnostics_.empty() && diagnostics_.back().offset == offset;
+  }
+  // Not locked, call when no parse is running.
+  vector<Diagnostic> &diagnostics() { return diagnostics_; }
+};
+
+struct ParserOptions {
+  // Lex the whole input into a TokenBuffer before parsing.
+  bool pretokenize = false;
+  // With pretokenize, lex on this many threads. 0 or 1 lexes in place.
+  size_t lex_threads = 0;
+  // Allocate nodes, and child lists too long to stay inline, from an
+  // Arena owned by the tree. This saves the heap allocation per node and
+  // lays nodes out in parse order. Nodes are still shared_ptrs, each
+  // holding a reference to the arena, so destructors run and freeing a
+  // tree still visits every node, see ArenaAllocator.
+  bool arena = false;
+  // Skip function bodies by brace matching and parse each one the first
+  // time body() is called on its FunctionDeclarationNode or
+  // FunctionExpressionNode. The tree is the same as without.
+  bool lazy_functions = false;
+  // Parse top-level statements on this many threads, see
+  // ParseProgramParallel. 0 or 1 parses in place.
+  size_t parse_threads = 0;
+  // Record syntax errors in diagnostics, replace the statement that
+  // failed with an ErrorNode and keep going. Off, the first error asserts,
+  // which is only useful when debugging the parser itself.
+  bool recover = true;
+  // Build a ScopeTree while parsing, see Parser::scopes. Function bodies
+  // are then parsed eagerly and top-level statements on one thread,
+  // whatever lazy_functions and parse_threads say.
+  bool scopes = false;
+};
+
+using BinaryOpPrecedences =
+    array<int, static_cast<size_t>(TokenType::kTokenTypeCount)>;
 
-  Parser(string source) : lexer_(new Lexer(source)) {
-    InstallBinaryOpPrecedences(kDefaultBinaryOpPrecedences);
+// Precedence of every binary and logical operator token, UNDEFINED for
+// tokens that are not binary operators. Higher binds tighter.
+inline constexpr BinaryOpPrecedences kBinaryOpPrecedences = [] {
+  BinaryOpPrecedences precedences{};
+  for (auto &precedence : precedences) {
+    precedence = UNDEFINED;
   }
+  auto set = [&](TokenType token, int precedence) {
+    precedences[static_cast<size_t>(token)] = precedence;
+  };
+  set(TokenType::kOrToken, 3);
+  set(TokenType::kQuestionQuestionToken, 3);
+  set(TokenType::kAndToken, 4);
+  set(TokenType::kBitOrToken, 5);
+  set(TokenType::kBitXorToken, 6);
+  set(TokenType::kBitAndToken, 7);
+  set(TokenType::kEqualEqualToken, 8);
+  set(TokenType::kNotEqualToken, 8);
+  set(TokenType::kEqualEqualEqualToken, 8);
+  set(TokenType::kNotEqualEqualToken, 8);
+  set(TokenType::kLessThanToken, 9);
+  set(TokenType::kLessEqualToken, 9);
+  set(TokenType::kGreaterThanToken, 9);
+  set(TokenType::kGreaterEqualToken, 9);
+  set(TokenType::kInToken, 9);
+  set(TokenType::kInstanceOfToken, 9);
+  set(TokenType::kLessLessToken, 10);
+  set(TokenType::kGreaterGreaterToken, 10);
+  set(TokenType::kGreaterGreaterGreaterToken, 10);
+  set(TokenType::kAddToken, 11);
+  set(TokenType::kSubToken, 11);
+  set(TokenType::kMulToken, 12);
+  set(TokenType::kDivToken, 12);
+  set(TokenType::kModToken, 12);
+  set(TokenType::kExpToken, 13);
+  return precedences;
+}();
+
+// Byte range of a skipped function body, from its `{` to just past its
+// `}`, and what is needed to parse it the way the enclosing parse would.
+struct LazyFunctionBody {
+  // Owns or views the source, bodies are parsed by a fresh Lexer over it.
+  shared_ptr<Lexer> lexer;
+  // With options.arena, each body gets an arena of its own, so bodies
+  // parsed on different threads do not share one.
+  ParserOptions options;
+  shared_ptr<BinaryOpPrecedences> binary_op_precedence_overrides;
+  // Errors in the body are appended here when it is parsed.
+  shared_ptr<DiagnosticList> diagnostics;
+  // Table of the enclosing tree. The body's names are interned into it
+  // through an AtomCache, so bodies may be parsed on different threads.
+  shared_ptr<AtomTable> atoms;
+  // In the coordinates of lexer's source, like the offsets of the parsed
+  // body.
+  uint32_t start;
+  uint32_t end;
+};
+
+// Replaces deleted bytes at offset with inserted. Edits in a list apply in
+// order, each to the text left by the ones before it.
+struct TextEdit {
+  size_t offset;
+  size_t deleted;
+  string inserted;
+};
 
+class ThreadPool;
+
+// An operator whose operands are still being parsed.
+struct PendingOperator {
+  enum class Kind : uint8_t { kUnary, kBinary, kParen };
+  Kind kind;
+  TokenType token;
+  // Binary operators only.
+  int precedence;
+  // Unary operators and parens, a binary node starts at its left operand.
+  uint32_t start;
+};
+
+class Parser {
+  friend SN ParseLazyFunctionBody(const LazyFunctionBody &body);
+
+  shared_ptr<Lexer> lexer_;
+  // Keeps the source alive for lazy bodies. lexer_ itself, except while
+  // parsing a lazy body, where lexer_ is a view over this lexer's source.
+  shared_ptr<Lexer> source_lexer_;
+  ParserOptions options_;
+  shared_ptr<Arena> arena_;
+  // Points at kBinaryOpPrecedences unless precedences were installed.
+  const BinaryOpPrecedences *binary_op_precedences_ = &kBinaryOpPrecedences;
+  shared_ptr<BinaryOpPrecedences> binary_op_precedence_overrides_;
+  // Operators and operands of the expressions being parsed, see
+  // ParseOperatorExpression. Kept across calls so a parse does not
+  // allocate them per expression.
+  vector<PendingOperator> pending_operators_;
+  vector<SN> pending_operands_;
+  // Shared with the lazy bodies of the tree being built.
+  shared_ptr<DiagnosticList> diagnostics_ = make_shared<DiagnosticList>();
+  // Held by the ProgramNode and lazy bodies of this parse, see AtomTable.
+  shared_ptr<AtomTable> atoms_ = make_shared<AtomTable>();
+  // Set wherever atoms_ may be interned into by another thread: in the
+  // ranges of ParseProgramParallel, in lazy bodies, and once a parse has
+  // skipped a body.
+  unique_ptr<AtomCache> atom_cache_;
+  // Set by Error, cleared by Recover once it has skipped the statement.
+  bool panicking_ = false;
+  // Start of the token after the last `;` a statement ended with since
+  // Recover began. A failed statement that stops there needs no skipping.
+  size_t semicolon_end_ = SIZE_MAX;
+  // Only with options_.scopes.
+  shared_ptr<ScopeTree> scope_tree_;
+  ScopeBuilder scope_builder_;
+
+  template <typename T, typename... Args>
+  shared_ptr<T> NewNode(size_t start, Args &&...args) {
+    shared_ptr<T> node;
+    if (arena_) {
+      node = allocate_shared<T>(ArenaAllocator<T>(arena_),
+                                forward<Args>(args)...);
+    } else {
+      node = make_shared<T>(forward<Args>(args)...);
+    }
+    node->set_start(start);
+    return node;
+  }
+
+  Atom Intern(string_view name) {
+    return atom_cache_ ? atom_cache_->Intern(name) : atoms_->Intern(name);
+  }
+
+  void StartLexing();
+  void BeginScopes();
+  void DeclareBinding(const SN &id, BindingKind kind);
+  void ReferenceBinding(const SN &identifier);
+  // Empties arena_ for reuse, or replaces it if a tree still holds it.
+  void RenewArena();
+
+  // Parser over its own Lexer viewing source_lexer's source, positioned on
+  // the token at offset, with the same options and precedences.
+  static unique_ptr<Parser>
+  NewViewParser(shared_ptr<Lexer> source_lexer, ParserOptions options,
+                shared_ptr<BinaryOpPrecedences> binary_op_precedence_overrides,
+                size_t offset);
+
+public:
+  Parser(shared_ptr<Lexer> lexer, ParserOptions options = ParserOptions())
+      : lexer_(move(lexer)), source_lexer_(lexer_), options_(options),
+        arena_(options.arena ? make_shared<Arena>() : nullptr) {}
+
+  Parser(string source, ParserOptions options = ParserOptions())
+      : lexer_(new Lexer(move(source))), source_lexer_(lexer_),
+        options_(options),
+        arena_(options.arena ? make_shared<Arena>() : nullptr) {}
+
+  // Makes the parser parse source with options, as if newly constructed,
+  // but keeps what earlier parses allocated: the lexer's token buffer, the
+  // expression stacks and the first arena block. Installed binary operator
+  // precedences stay installed. Trees from earlier parses stay valid, the
+  // lexer, arena, diagnostics and atom table still used by one are
+  // replaced instead of reused.
+  void Reset(string source, ParserOptions options = ParserOptions());
+  // Undoes InstallBinaryOpPrecedences.
+  void ResetBinaryOpPrecedences();
   SN Parse();
+  // Parses the program one top-level statement at a time and passes each
+  // to callback as soon as it is complete. Unless callback keeps it, the
+  // statement is freed before the next one is parsed, so memory beyond the
+  // source stays bounded by the largest statement. parse_threads is
+  // ignored. The statements have no ProgramNode to hold atoms(), so one
+  // kept past the next Reset needs atoms() kept with it.
+  void ParseStreaming(const function<void(SN)> &callback);
+  // Applies edits to the source of program, which this parser produced by
+  // Parse or an earlier Reparse, and returns the tree for the edited
+  // source. Top-level statements before the edits are shared with program,
+  // which is left as it was. Those after them are copied with their
+  // offsets moved. Nothing there is parsed again and lazy bodies stay
+  // unparsed, but every node is visited, and those lazy bodies must not be
+  // parsed on other threads during the call. The parser then holds the
+  // edited source. With ParserOptions::scopes the whole source is parsed.
+  // Returns nullptr, changing nothing, if program is not the last tree of
+  // this parser or an edit reaches past the end of the text it applies to.
+  SN Reparse(const SN &program, const vector<TextEdit> &edits);
+  SourcePosition GetPosition(size_t offset) {
+    return lexer_->line_index().GetPosition(offset);
+  }
+  // Syntax errors of the last parse in source order, followed by those of
+  // lazy bodies in the order the bodies were parsed.
+  const vector<Diagnostic> &diagnostics() const {
+    return diagnostics_->diagnostics();
+  }
+  // Arena holding the tree in arena mode, for its allocation statistics.
+  shared_ptr<Arena> arena() const { return arena_; }
+  // Table the identifiers of the last parse were interned into, for
+  // reading the names of ScopeTree atoms, or keeping statements from
+  // ParseStreaming readable.
+  shared_ptr<AtomTable> atoms() const { return atoms_; }
+  // Scopes, bindings and resolved references of the last parse with
+  // ParserOptions::scopes, nullptr without.
+  shared_ptr<const ScopeTree> scopes() const { return scope_tree_; }
   SN ParseUnaryExpression();
-  SN ParseBinaryExpression(SN left,
-                                         int precedence);
+  SN ParseOperatorExpression(bool unary);
+  SN ParsePrimaryExpression();
   SN ParseIdentifier();
+  SN ParseIdentifierName();
   SN ParseStringLiteral();
   SN ParseNumericLiteral();
   SN ParseNullLiteral();
@@ -1178,16 +1634,19 @@ public:
   SN ParseForStatement();
   SN ParseVariableDeclaration();
   SN ParseVariableDeclarator();
-  SN ParseForInStatement(SN left);
-  SN ParseForOfStatement(SN left, bool await);
+  SN ParseForInStatement(SN left, size_t start);
+  SN ParseForOfStatement(SN left, bool await, size_t start);
   SN ParseForInStatementOrForOfStatement();
   SN ParseThrowStatement();
   SN ParseTryStatement();
   SN ParseCatchClause();
   SN ParseFunctionExpression();
   SN ParseFunctionDeclaration();
-  SVSN ParseFunctionParams();
+  SN ParseFunctionRest(size_t start, SN id, bool generator, bool async,
+                       bool expression);
+  NodeList ParseFunctionParams();
   SN ParseImportDeclaration();
+  SN ParseModuleSpecifier();
   SN ParseImportSpecifier();
   SN ParseImportDefaultSpecifier();
   SN ParseImportNamespaceSpecifier();
@@ -1199,16 +1658,31 @@ public:
   SN ParseExportNamedDeclarationOrExportDefaultDeclaration();
   SN ParseExportAllDeclaration();
   SN ParseDeclaration();
+  SN Error(const char *message);
+  bool Expect(TokenType token, const char *message);
+  void Synchronize();
+  SN Recover(SN (Parser::*parse)());
+  SN ParseStatementListItem();
+  SN ParseModuleItem();
+  SN ParseTopLevelStatement();
   SN ParseProgram();
+  SN ParseProgramParallel(ThreadPool &pool);
   SN ParseCallExpression(SN callee);
   SN ParseIdentifierOrCallExpression();
-  SVSN ParseCallExpressionArguments();
+  NodeList ParseCallExpressionArguments();
 
   void
   InstallBinaryOpPrecedences(map<BinaryOperator, int> binary_op_precedences);
-  int GetBinaryOpPrecedence(BinaryOperator op);
+  int GetBinaryOpPrecedence(TokenType token) {
+    return (*binary_op_precedences_)[static_cast<size_t>(token)];
+  }
+  static bool CheckIsRightAssociative(TokenType token) {
+    return token == TokenType::kExpToken;
+  }
   BinaryOperator GetBinaryOpFromToken(TokenType token);
   bool CheckIsBianryOp(TokenType token);
+  static UnaryOperator GetUnaryOpFromToken(TokenType token);
+  static bool CheckIsUnaryOp(TokenType token);
   VariableDeclarationKind GetVariableDeclarationKindFromToken(TokenType token);
   bool CheckIsVariableDeclaration(TokenType token);
 };
@@ -0,0 +1,49 @@
+#pragma once
+#include "parser.hpp"
+#include <memory>
+#include <string>
+#include <vector>
+using namespace std;
+
+// Parser borrowed from a free list kept per thread and handed back on
+// destruction with its default precedences restored. Parsing many small
+// inputs on one thread then goes through Parser::Reset instead of building
+// a parser, a lexer and their buffers per input. A parser waiting in the
+// free list keeps its last source alive until it is borrowed again.
+class PooledParser {
+  // More than one only while pooled parsers are nested on a thread.
+  static constexpr size_t kMaxFreeParsers = 4;
+
+  unique_ptr<Parser> parser_;
+
+  static vector<unique_ptr<Parser>> &FreeParsers() {
+    thread_local vector<unique_ptr<Parser>> free_parsers;
+    return free_parsers;
+  }
+
+public:
+  PooledParser(string source, ParserOptions options = ParserOptions()) {
+    auto &free_parsers = FreeParsers();
+    if (free_parsers.empty()) {
+      parser_ = make_unique<Parser>(move(source), options);
+      return;
+    }
+    parser_ = move(free_parsers.back());
+    free_parsers.pop_back();
+    parser_->Reset(move(source), options);
+  }
+
+  ~PooledParser() {
+    auto &free_parsers = FreeParsers();
+    if (free_parsers.size() < kMaxFreeParsers) {
+      parser_->ResetBinaryOpPrecedences();
+      free_parsers.push_back(move(parser_));
+    }
+  }
+
+  PooledParser(const PooledParser &) = delete;
+  PooledParser &operator=(const PooledParser &) = delete;
+
+  Parser &operator*() const { return *parser_; }
+  Parser *operator->() const { return parser_.get(); }
+};
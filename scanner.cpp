@@ -0,0 +1,379 @@
+#include "scanner.hpp"
+
+#if defined(__SSE2__)
+#include <immintrin.h>
+#define YAJP_X86_SIMD 1
+#endif
+
+#if defined(__wasm_simd128__)
+#include <wasm_simd128.h>
+#endif
+
+namespace {
+
+inline bool IsWhitespaceChar(char c) {
+  return c == ' ' || (c >= '\t' && c <= '\r');
+}
+
+inline bool IsIdentifierChar(char c) {
+  char lower = c | 0x20;
+  return (lower >= 'a' && lower <= 'z') || (c >= '0' && c <= '9') ||
+         c == '_' || c == '$';
+}
+
+const char *ScalarWhitespace(const char *p, const char *end) {
+  while (p < end && IsWhitespaceChar(*p)) {
+    p++;
+  }
+  return p;
+}
+
+const char *ScalarIdentifier(const char *p, const char *end) {
+  while (p < end && IsIdentifierChar(*p)) {
+    p++;
+  }
+  return p;
+}
+
+const char *ScalarStringBody(const char *p, const char *end, char quote) {
+  while (p < end && *p != quote && *p != '\\') {
+    p++;
+  }
+  return p;
+}
+
+const char *ScalarNewline(const char *p, const char *end) {
+  while (p < end && *p != '\n') {
+    p++;
+  }
+  return p;
+}
+
+inline bool IsBraceBodyStop(char c) {
+  return c == '{' || c == '}' || c == '\'' || c == '"' || c == '/';
+}
+
+const char *ScalarBraceBody(const char *p, const char *end) {
+  while (p < end && !IsBraceBodyStop(*p)) {
+    p++;
+  }
+  return p;
+}
+
+// Byte masks are built with signed compares. Every bound is ASCII, so bytes
+// >= 0x80 read as negative and never fall inside a range.
+
+#if defined(YAJP_X86_SIMD)
+
+inline __m128i InRange16(__m128i v, char lo, char hi) {
+  return _mm_and_si128(_mm_cmpgt_epi8(v, _mm_set1_epi8(lo - 1)),
+                       _mm_cmplt_epi8(v, _mm_set1_epi8(hi + 1)));
+}
+
+inline unsigned WhitespaceMask16(__m128i v) {
+  auto space = _mm_cmpeq_epi8(v, _mm_set1_epi8(' '));
+  auto control = InRange16(v, '\t', '\r');
+  return _mm_movemask_epi8(_mm_or_si128(space, control));
+}
+
+inline unsigned IdentifierMask16(__m128i v) {
+  auto alpha = InRange16(_mm_or_si128(v, _mm_set1_epi8(0x20)), 'a', 'z');
+  auto digit = InRange16(v, '0', '9');
+  auto underscore = _mm_cmpeq_epi8(v, _mm_set1_epi8('_'));
+  auto dollar = _mm_cmpeq_epi8(v, _mm_set1_epi8('$'));
+  return _mm_movemask_epi8(_mm_or_si128(_mm_or_si128(alpha, digit),
+                                        _mm_or_si128(underscore, dollar)));
+}
+
+const char *Sse2Whitespace(const char *p, const char *end) {
+  for (; p + 16 <= end; p += 16) {
+    auto v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+    unsigned mask = WhitespaceMask16(v);
+    if (mask != 0xFFFF) {
+      return p + __builtin_ctz(~mask);
+    }
+  }
+  return ScalarWhitespace(p, end);
+}
+
+const char *Sse2Identifier(const char *p, const char *end) {
+  for (; p + 16 <= end; p += 16) {
+    auto v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+    unsigned mask = IdentifierMask16(v);
+    if (mask != 0xFFFF) {
+      return p + __builtin_ctz(~mask);
+    }
+  }
+  return ScalarIdentifier(p, end);
+}
+
+const char *Sse2StringBody(const char *p, const char *end, char quote) {
+  auto quotes = _mm_set1_epi8(quote);
+  auto backslashes = _mm_set1_epi8('\\');
+  for (; p + 16 <= end; p += 16) {
+    auto v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+    unsigned mask = _mm_movemask_epi8(_mm_or_si128(
+        _mm_cmpeq_epi8(v, quotes), _mm_cmpeq_epi8(v, backslashes)));
+    if (mask != 0) {
+      return p + __builtin_ctz(mask);
+    }
+  }
+  return ScalarStringBody(p, end, quote);
+}
+
+const char *Sse2Newline(const char *p, const char *end) {
+  auto newlines = _mm_set1_epi8('\n');
+  for (; p + 16 <= end; p += 16) {
+    auto v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+    unsigned mask = _mm_movemask_epi8(_mm_cmpeq_epi8(v, newlines));
+    if (mask != 0) {
+      return p + __builtin_ctz(mask);
+    }
+  }
+  return ScalarNewline(p, end);
+}
+
+inline __m128i BraceBodyStops16(__m128i v) {
+  auto braces = _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('{')),
+                             _mm_cmpeq_epi8(v, _mm_set1_epi8('}')));
+  auto quotes = _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('\'')),
+                             _mm_cmpeq_epi8(v, _mm_set1_epi8('"')));
+  auto slash = _mm_cmpeq_epi8(v, _mm_set1_epi8('/'));
+  return _mm_or_si128(_mm_or_si128(braces, quotes), slash);
+}
+
+const char *Sse2BraceBody(const char *p, const char *end) {
+  for (; p + 16 <= end; p += 16) {
+    auto v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+    unsigned mask = _mm_movemask_epi8(BraceBodyStops16(v));
+    if (mask != 0) {
+      return p + __builtin_ctz(mask);
+    }
+  }
+  return ScalarBraceBody(p, end);
+}
+
+#define AVX2 __attribute__((target("avx2")))
+
+AVX2 inline __m256i InRange32(__m256i v, char lo, char hi) {
+  return _mm256_and_si256(_mm256_cmpgt_epi8(v, _mm256_set1_epi8(lo - 1)),
+                          _mm256_cmpgt_epi8(_mm256_set1_epi8(hi + 1), v));
+}
+
+AVX2 const char *Avx2Whitespace(const char *p, const char *end) {
+  for (; p + 32 <= end; p += 32) {
+    auto v = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p));
+    auto space = _mm256_cmpeq_epi8(v, _mm256_set1_epi8(' '));
+    auto control = InRange32(v, '\t', '\r');
+    unsigned mask = _mm256_movemask_epi8(_mm256_or_si256(space, control));
+    if (mask != 0xFFFFFFFF) {
+      return p + __builtin_ctz(~mask);
+    }
+  }
+  return Sse2Whitespace(p, end);
+}
+
+AVX2 const char *Avx2Identifier(const char *p, const char *end) {
+  for (; p + 32 <= end; p += 32) {
+    auto v = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p));
+    auto alpha =
+        InRange32(_mm256_or_si256(v, _mm256_set1_epi8(0x20)), 'a', 'z');
+    auto digit = InRange32(v, '0', '9');
+    auto underscore = _mm256_cmpeq_epi8(v, _mm256_set1_epi8('_'));
+    auto dollar = _mm256_cmpeq_epi8(v, _mm256_set1_epi8('$'));
+    unsigned mask = _mm256_movemask_epi8(_mm256_or_si256(
+        _mm256_or_si256(alpha, digit), _mm256_or_si256(underscore, dollar)));
+    if (mask != 0xFFFFFFFF) {
+      return p + __builtin_ctz(~mask);
+    }
+  }
+  return Sse2Identifier(p, end);
+}
+
+AVX2 const char *Avx2StringBody(const char *p, const char *end, char quote) {
+  auto quotes = _mm256_set1_epi8(quote);
+  auto backslashes = _mm256_set1_epi8('\\');
+  for (; p + 32 <= end; p += 32) {
+    auto v = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p));
+    unsigned mask = _mm256_movemask_epi8(_mm256_or_si256(
+        _mm256_cmpeq_epi8(v, quotes), _mm256_cmpeq_epi8(v, backslashes)));
+    if (mask != 0) {
+      return p + __builtin_ctz(mask);
+    }
+  }
+  return Sse2StringBody(p, end, quote);
+}
+
+AVX2 const char *Avx2Newline(const char *p, const char *end) {
+  auto newlines = _mm256_set1_epi8('\n');
+  for (; p + 32 <= end; p += 32) {
+    auto v = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p));
+    unsigned mask = _mm256_movemask_epi8(_mm256_cmpeq_epi8(v, newlines));
+    if (mask != 0) {
+      return p + __builtin_ctz(mask);
+    }
+  }
+  return Sse2Newline(p, end);
+}
+
+AVX2 const char *Avx2BraceBody(const char *p, const char *end) {
+  for (; p + 32 <= end; p += 32) {
+    auto v = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p));
+    auto braces =
+        _mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('{')),
+                        _mm256_cmpeq_epi8(v, _mm256_set1_epi8('}')));
+    auto quotes =
+        _mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('\'')),
+                        _mm256_cmpeq_epi8(v, _mm256_set1_epi8('"')));
+    auto slash = _mm256_cmpeq_epi8(v, _mm256_set1_epi8('/'));
+    unsigned mask = _mm256_movemask_epi8(
+        _mm256_or_si256(_mm256_or_si256(braces, quotes), slash));
+    if (mask != 0) {
+      return p + __builtin_ctz(mask);
+    }
+  }
+  return Sse2BraceBody(p, end);
+}
+
+#undef AVX2
+
+#endif
+
+#if defined(__wasm_simd128__)
+
+inline v128_t InRangeWasm(v128_t v, char lo, char hi) {
+  return wasm_v128_and(wasm_i8x16_gt(v, wasm_i8x16_splat(lo - 1)),
+                       wasm_i8x16_lt(v, wasm_i8x16_splat(hi + 1)));
+}
+
+const char *WasmWhitespace(const char *p, const char *end) {
+  for (; p + 16 <= end; p += 16) {
+    auto v = wasm_v128_load(p);
+    auto space = wasm_i8x16_eq(v, wasm_i8x16_splat(' '));
+    auto control = InRangeWasm(v, '\t', '\r');
+    unsigned mask = wasm_i8x16_bitmask(wasm_v128_or(space, control));
+    if (mask != 0xFFFF) {
+      return p + __builtin_ctz(~mask);
+    }
+  }
+  return ScalarWhitespace(p, end);
+}
+
+const char *WasmIdentifier(const char *p, const char *end) {
+  for (; p + 16 <= end; p += 16) {
+    auto v = wasm_v128_load(p);
+    auto alpha = InRangeWasm(wasm_v128_or(v, wasm_i8x16_splat(0x20)), 'a', 'z');
+    auto digit = InRangeWasm(v, '0', '9');
+    auto underscore = wasm_i8x16_eq(v, wasm_i8x16_splat('_'));
+    auto dollar = wasm_i8x16_eq(v, wasm_i8x16_splat('$'));
+    unsigned mask = wasm_i8x16_bitmask(wasm_v128_or(
+        wasm_v128_or(alpha, digit), wasm_v128_or(underscore, dollar)));
+    if (mask != 0xFFFF) {
+      return p + __builtin_ctz(~mask);
+    }
+  }
+  return ScalarIdentifier(p, end);
+}
+
+const char *WasmStringBody(const char *p, const char *end, char quote) {
+  auto quotes = wasm_i8x16_splat(quote);
+  auto backslashes = wasm_i8x16_splat('\\');
+  for (; p + 16 <= end; p += 16) {
+    auto v = wasm_v128_load(p);
+    unsigned mask = wasm_i8x16_bitmask(
+        wasm_v128_or(wasm_i8x16_eq(v, quotes), wasm_i8x16_eq(v, backslashes)));
+    if (mask != 0) {
+      return p + __builtin_ctz(mask);
+    }
+  }
+  return ScalarStringBody(p, end, quote);
+}
+
+const char *WasmNewline(const char *p, const char *end) {
+  auto newlines = wasm_i8x16_splat('\n');
+  for (; p + 16 <= end; p += 16) {
+    auto v = wasm_v128_load(p);
+    unsigned mask = wasm_i8x16_bitmask(wasm_i8x16_eq(v, newlines));
+    if (mask != 0) {
+      return p + __builtin_ctz(mask);
+    }
+  }
+  return ScalarNewline(p, end);
+}
+
+const char *WasmBraceBody(const char *p, const char *end) {
+  for (; p + 16 <= end; p += 16) {
+    auto v = wasm_v128_load(p);
+    auto braces = wasm_v128_or(wasm_i8x16_eq(v, wasm_i8x16_splat('{')),
+                               wasm_i8x16_eq(v, wasm_i8x16_splat('}')));
+    auto quotes = wasm_v128_or(wasm_i8x16_eq(v, wasm_i8x16_splat('\'')),
+                               wasm_i8x16_eq(v, wasm_i8x16_splat('"')));
+    auto slash = wasm_i8x16_eq(v, wasm_i8x16_splat('/'));
+    unsigned mask =
+        wasm_i8x16_bitmask(wasm_v128_or(wasm_v128_or(braces, quotes), slash));
+    if (mask != 0) {
+      return p + __builtin_ctz(mask);
+    }
+  }
+  return ScalarBraceBody(p, end);
+}
+
+#endif
+
+struct ScanKernels {
+  const char *(*whitespace)(const char *, const char *);
+  const char *(*identifier)(const char *, const char *);
+  const char *(*string_body)(const char *, const char *, char);
+  const char *(*newline)(const char *, const char *);
+  const char *(*brace_body)(const char *, const char *);
+};
+
+ScanKernels SelectKernels() {
+#if defined(YAJP_X86_SIMD)
+  // May run before the runtime's own constructor has filled in the CPU
+  // model, see Kernels.
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2")) {
+    return {Avx2Whitespace, Avx2Identifier, Avx2StringBody, Avx2Newline,
+            Avx2BraceBody};
+  }
+  return {Sse2Whitespace, Sse2Identifier, Sse2StringBody, Sse2Newline,
+          Sse2BraceBody};
+#elif defined(__wasm_simd128__)
+  return {WasmWhitespace, WasmIdentifier, WasmStringBody, WasmNewline,
+          WasmBraceBody};
+#else
+  return {ScalarWhitespace, ScalarIdentifier, ScalarStringBody,
+          ScalarNewline, ScalarBraceBody};
+#endif
+}
+
+// Selected on first use rather than by a namespace-scope initializer, so a
+// lexer run from another translation unit's static initializer does not
+// see the pointers before they are set.
+const ScanKernels &Kernels() {
+  static const ScanKernels kernels = SelectKernels();
+  return kernels;
+}
+
+} // namespace
+
+const char *ScanWhitespace(const char *p, const char *end) {
+  return Kernels().whitespace(p, end);
+}
+
+const char *ScanIdentifier(const char *p, const char *end) {
+  return Kernels().identifier(p, end);
+}
+
+const char *ScanStringBody(const char *p, const char *end, char quote) {
+  return Kernels().string_body(p, end, quote);
+}
+
+const char *ScanNewline(const char *p, const char *end) {
+  return Kernels().newline(p, end);
+}
+
+const char *ScanBraceBody(const char *p, const char *end) {
+  return Kernels().brace_body(p, end);
+}
@@ -0,0 +1,21 @@
+#pragma once
+
+// Vectorized scanning kernels used by the lexer on long runs. Each returns
+// the first position in [p, end) that ends the run, or end. The kernel set
+// (AVX2, SSE2, WASM SIMD128 or scalar) is picked on the first call.
+
+// Skips ' ', '\t', '\n', '\v', '\f' and '\r'.
+const char *ScanWhitespace(const char *p, const char *end);
+
+// Skips [A-Za-z0-9_$].
+const char *ScanIdentifier(const char *p, const char *end);
+
+// Stops at the closing quote or at a backslash.
+const char *ScanStringBody(const char *p, const char *end, char quote);
+
+// Stops at the next '\n'.
+const char *ScanNewline(const char *p, const char *end);
+
+// Stops at '{', '}', '\'', '"' or '/', the bytes that matter when skipping
+// over a balanced brace block.
+const char *ScanBraceBody(const char *p, const char *end);
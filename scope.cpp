@@ -0,0 +1,125 @@
+#include "scope.hpp"
+#include <algorithm>
+
+uint32_t ScopeTree::BindingAt(size_t offset) const {
+  auto iter = lower_bound(references.begin(), references.end(), offset,
+                          [](const Reference &reference, size_t offset) {
+                            return reference.offset < offset;
+                          });
+  if (iter == references.end() || iter->offset != offset) {
+    return kNoBinding;
+  }
+  return iter->binding;
+}
+
+uint32_t &ScopeBuilder::Innermost(Atom name) {
+  if (name >= innermost_.size()) {
+    innermost_.resize(name + 1, kNoBinding);
+  }
+  return innermost_[name];
+}
+
+void ScopeBuilder::Begin(ScopeTree *tree, size_t start) {
+  tree_ = tree;
+  depth_ = 0;
+  shadowed_.clear();
+  Open(ScopeKind::kModule, start);
+}
+
+void ScopeBuilder::End() {
+  if (!tree_) {
+    return;
+  }
+  CloseTo(0);
+  auto &references = tree_->references;
+  auto by_offset = [](const auto &lhs, const auto &rhs) {
+    return lhs.offset < rhs.offset;
+  };
+  if (!is_sorted(references.begin(), references.end(), by_offset)) {
+    stable_sort(references.begin(), references.end(), by_offset);
+  }
+  tree_ = nullptr;
+}
+
+size_t ScopeBuilder::Open(ScopeKind kind, size_t start) {
+  if (!tree_) {
+    return depth_;
+  }
+  auto parent = depth_ > 0 ? open_[depth_ - 1].id : kNoScope;
+  auto id = static_cast<uint32_t>(tree_->scopes.size());
+  tree_->scopes.push_back({kind, parent, static_cast<uint32_t>(start)});
+  if (depth_ == open_.size()) {
+    open_.emplace_back();
+  }
+  auto &scope = open_[depth_];
+  scope.id = id;
+  scope.bindings.clear();
+  scope.pending.clear();
+  return depth_++;
+}
+
+void ScopeBuilder::CloseTo(size_t depth) {
+  while (tree_ && depth_ > depth) {
+    Close();
+  }
+}
+
+// Resolves the references that reach the innermost scope against its
+// bindings, passes the others out and unlinks its bindings.
+void ScopeBuilder::Close() {
+  auto &scope = open_[depth_ - 1];
+  for (auto index : scope.pending) {
+    auto &reference = tree_->references[index];
+    auto binding = Innermost(reference.name);
+    if (binding != kNoBinding && tree_->bindings[binding].scope == scope.id) {
+      reference.binding = binding;
+    } else if (depth_ > 1) {
+      open_[depth_ - 2].pending.push_back(index);
+    }
+  }
+  for (auto iter = scope.bindings.rbegin(); iter != scope.bindings.rend();
+       iter++) {
+    auto binding = *iter;
+    auto *link = &Innermost(tree_->bindings[binding].name);
+    // Only a redeclaration the parser does not reject puts another
+    // binding in front of this one.
+    while (*link != binding && *link != kNoBinding) {
+      link = &shadowed_[*link];
+    }
+    *link = shadowed_[binding];
+  }
+  scope.bindings.clear();
+  scope.pending.clear();
+  depth_--;
+}
+
+void ScopeBuilder::Declare(Atom name, BindingKind kind, size_t offset) {
+  if (!tree_) {
+    return;
+  }
+  auto target = depth_ - 1;
+  if (kind == BindingKind::kVar) {
+    while (target > 0 && tree_->scopes[open_[target].id].kind !=
+                             ScopeKind::kFunction) {
+      target--;
+    }
+  }
+  auto id = static_cast<uint32_t>(tree_->bindings.size());
+  tree_->bindings.push_back(
+      {name, kind, open_[target].id, static_cast<uint32_t>(offset)});
+  open_[target].bindings.push_back(id);
+  auto &innermost = Innermost(name);
+  shadowed_.push_back(innermost);
+  innermost = id;
+}
+
+void ScopeBuilder::Reference(Atom name, size_t offset) {
+  if (!tree_) {
+    return;
+  }
+  auto scope = open_[depth_ - 1].id;
+  auto index = static_cast<uint32_t>(tree_->references.size());
+  tree_->references.push_back(
+      {static_cast<uint32_t>(offset), name, scope, kNoBinding});
+  open_[depth_ - 1].pending.push_back(index);
+}
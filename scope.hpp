@@ -0,0 +1,114 @@
+#pragma once
+#include "atom.hpp"
+#include <climits>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+using namespace std;
+
+enum class ScopeKind : uint8_t {
+  kModule,
+  kFunction,
+  kBlock,
+  kCatch,
+};
+
+enum class BindingKind : uint8_t {
+  kVar,
+  kLet,
+  kConst,
+  kFunction,
+  kParam,
+  kCatchParam,
+  kImport,
+};
+
+inline constexpr uint32_t kNoScope = UINT32_MAX;
+inline constexpr uint32_t kNoBinding = UINT32_MAX;
+
+struct Scope {
+  ScopeKind kind;
+  // kNoScope for the module scope.
+  uint32_t parent;
+  // Start of the node that opens it: the program, block, for statement,
+  // catch clause or function.
+  uint32_t start;
+};
+
+struct Binding {
+  Atom name;
+  BindingKind kind;
+  // A var is declared in the nearest function or module scope.
+  uint32_t scope;
+  // Start of the declaring identifier.
+  uint32_t offset;
+};
+
+// An identifier read or written as a variable, as opposed to one that
+// declares a binding or names an import or export.
+struct Reference {
+  // Start of the identifier.
+  uint32_t offset;
+  Atom name;
+  // Innermost scope it appears in.
+  uint32_t scope;
+  // kNoBinding for a global.
+  uint32_t binding;
+};
+
+// Scopes, bindings and references of a program, ids are indices. Built by
+// the parser with ParserOptions::scopes.
+struct ScopeTree {
+  // scopes[0] is the module scope, every scope comes after its parent.
+  vector<Scope> scopes;
+  vector<Binding> bindings;
+  // In source order.
+  vector<Reference> references;
+
+  // Binding the identifier at offset refers to. kNoBinding for a global,
+  // or if no reference starts at offset.
+  uint32_t BindingAt(size_t offset) const;
+};
+
+// Builds a ScopeTree as the parser opens and closes scopes. References
+// cannot be resolved where they appear, since a var or function may be
+// declared further down, so each scope resolves the references left in it
+// when it closes and hands the rest to its parent. The innermost binding
+// of every name among the open scopes is kept in a table indexed by atom,
+// so a reference costs a lookup per scope it passes through.
+class ScopeBuilder {
+  struct OpenScope {
+    uint32_t id;
+    vector<uint32_t> bindings;
+    // References not resolved in an inner scope.
+    vector<uint32_t> pending;
+  };
+
+  ScopeTree *tree_ = nullptr;
+  // [0, depth_) are open, the rest kept for their buffers.
+  vector<OpenScope> open_;
+  size_t depth_ = 0;
+  // Innermost binding of each atom among the open scopes.
+  vector<uint32_t> innermost_;
+  // Binding each binding shadows, by binding id.
+  vector<uint32_t> shadowed_;
+
+  uint32_t &Innermost(Atom name);
+  void Close();
+
+public:
+  // Starts tree with the module scope open.
+  void Begin(ScopeTree *tree, size_t start);
+  // Closes every scope still open.
+  void End();
+  bool active() const { return tree_ != nullptr; }
+
+  // Returns the depth to pass CloseTo to close the new scope along with
+  // any left open inside it.
+  size_t Open(ScopeKind kind, size_t start);
+  void CloseTo(size_t depth);
+  size_t depth() const { return depth_; }
+
+  void Declare(Atom name, BindingKind kind, size_t offset);
+  void Reference(Atom name, size_t offset);
+};
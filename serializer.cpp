@@ -0,0 +1,894 @@
+#include "serializer.hpp"
+#include "mapped_file.hpp"
+#include <climits>
+#include <cmath>
+#include <cstring>
+#include <deque>
+#include <unordered_map>
+#include <vector>
+
+namespace {
+
+const char kMagic[4] = {'y', 'a', 's', 't'};
+
+// Numeric literal flags. Integers up to 2^53 are written as varints, which
+// covers almost every literal in real code in one or two bytes.
+const uint8_t kBigIntFlag = 1;
+const uint8_t kIntegerFlag = 2;
+// A BigInt's source digits follow instead of its value.
+const uint8_t kDigitsFlag = 4;
+const double kMaxExactInteger = 9007199254740992.0;
+
+uint64_t ZigZag(int64_t value) {
+  return (static_cast<uint64_t>(value) << 1) ^
+         static_cast<uint64_t>(value >> 63);
+}
+
+int64_t UnZigZag(uint64_t value) {
+  return static_cast<int64_t>(value >> 1) ^ -static_cast<int64_t>(value & 1);
+}
+
+bool IsExactInteger(double value) {
+  return value >= 0 && value <= kMaxExactInteger && value == floor(value) &&
+         !(value == 0 && signbit(value));
+}
+
+// Writes the node stream to out and collects every identifier and string
+// literal into a table, each distinct text once.
+class Writer {
+  string &out_;
+  string table_;
+  // Owns the keys of string_indices_, node accessors return copies.
+  deque<string> strings_;
+  unordered_map<string_view, uint32_t> string_indices_;
+
+public:
+  Writer(string &out) : out_(out) {}
+
+  void Byte(uint8_t value) { out_.push_back(static_cast<char>(value)); }
+
+  void U32(uint32_t value) {
+    for (int shift = 0; shift < 32; shift += 8) {
+      Byte(static_cast<uint8_t>(value >> shift));
+    }
+  }
+
+  // LEB128, low seven bits first.
+  static void Varint(string &out, uint64_t value) {
+    while (value >= 0x80) {
+      out.push_back(static_cast<char>(value | 0x80));
+      value >>= 7;
+    }
+    out.push_back(static_cast<char>(value));
+  }
+
+  void Varint(uint64_t value) { Varint(out_, value); }
+
+  void Double(double value) {
+    char bytes[sizeof(value)];
+    memcpy(bytes, &value, sizeof(value));
+    out_.append(bytes, sizeof(bytes));
+  }
+
+  // Writes the table index of value, adding it on first use.
+  void String(string_view value) {
+    auto iter = string_indices_.find(value);
+    if (iter == string_indices_.end()) {
+      Varint(table_, value.size());
+      table_.append(value.data(), value.size());
+      strings_.emplace_back(value);
+      iter = string_indices_
+                 .emplace(strings_.back(),
+                          static_cast<uint32_t>(string_indices_.size()))
+                 .first;
+    }
+    Varint(iter->second);
+  }
+
+  size_t string_count() const { return string_indices_.size(); }
+  const string &table() const { return table_; }
+};
+
+// Reads past the end return zeros and mark the reader failed, callers
+// check failed() once per node. Strings are views into the data, which
+// must outlive the reader, so decoding a mapped file copies each distinct
+// text at most once, into the node or the atom table.
+class Reader {
+  const char *cursor_;
+  const char *end_;
+  bool failed_ = false;
+  vector<string_view> strings_;
+  // Table identifiers are interned into, see ChooseTable, and the atom of
+  // each string, interned on first use as an identifier.
+  AtomTable *table_ = nullptr;
+  shared_ptr<AtomTable> program_table_;
+  vector<Atom> atoms_;
+
+  static constexpr Atom kNoAtom = UINT32_MAX;
+
+  bool Need(size_t size) {
+    if (static_cast<size_t>(end_ - cursor_) < size) {
+      failed_ = true;
+      cursor_ = end_;
+      return false;
+    }
+    return true;
+  }
+
+  // Table index, or the table size after marking the reader failed.
+  size_t Index() {
+    auto index = Varint();
+    if (index >= strings_.size()) {
+      failed_ = true;
+      return strings_.size();
+    }
+    return static_cast<size_t>(index);
+  }
+
+public:
+  Reader(string_view data)
+      : cursor_(data.data()), end_(data.data() + data.size()) {}
+
+  bool failed() const { return failed_; }
+  bool at_end() const { return cursor_ == end_; }
+  void Fail() { failed_ = true; }
+
+  uint8_t Byte() {
+    if (!Need(1)) {
+      return 0;
+    }
+    return static_cast<uint8_t>(*cursor_++);
+  }
+
+  uint32_t U32() {
+    uint32_t value = 0;
+    for (int shift = 0; shift < 32; shift += 8) {
+      value |= static_cast<uint32_t>(Byte()) << shift;
+    }
+    return value;
+  }
+
+  uint64_t Varint() {
+    uint64_t value = 0;
+    for (int shift = 0; shift < 64; shift += 7) {
+      auto byte = Byte();
+      value |= static_cast<uint64_t>(byte & 0x7f) << shift;
+      if (!(byte & 0x80)) {
+        return value;
+      }
+    }
+    failed_ = true;
+    return 0;
+  }
+
+  // A count of items that each take at least one byte, so a corrupt count
+  // fails here instead of reserving memory for it.
+  size_t Count() {
+    auto count = Varint();
+    if (count > static_cast<size_t>(end_ - cursor_)) {
+      failed_ = true;
+      return 0;
+    }
+    return static_cast<size_t>(count);
+  }
+
+  double Double() {
+    double value = 0;
+    if (Need(sizeof(value))) {
+      memcpy(&value, cursor_, sizeof(value));
+      cursor_ += sizeof(value);
+    }
+    return value;
+  }
+
+  void ReadStringTable() {
+    auto count = Count();
+    strings_.reserve(count);
+    for (size_t i = 0; i < count && !failed_; i++) {
+      auto size = Varint();
+      if (!Need(size)) {
+        return;
+      }
+      strings_.emplace_back(cursor_, size);
+      cursor_ += size;
+    }
+    atoms_.assign(strings_.size(), kNoAtom);
+  }
+
+  string_view String() {
+    auto index = Index();
+    return index == strings_.size() ? string_view() : strings_[index];
+  }
+
+  Atom ReadAtom() {
+    auto index = Index();
+    if (index == strings_.size()) {
+      return 0;
+    }
+    if (atoms_[index] == kNoAtom) {
+      atoms_[index] = table_->InternShared(strings_[index]);
+    }
+    return atoms_[index];
+  }
+
+  // Called before the root is read. A program gets a table of its own,
+  // any other root is interned into AtomTable::Global(), like a subtree
+  // built by hand.
+  void ChooseTable() {
+    if (cursor_ != end_ &&
+        static_cast<uint8_t>(*cursor_) ==
+            static_cast<uint8_t>(NodeType::kProgram)) {
+      program_table_ = make_shared<AtomTable>();
+      table_ = program_table_.get();
+    } else {
+      table_ = &AtomTable::Global();
+    }
+  }
+
+  AtomTable *table() const { return table_; }
+  // nullptr unless the root is a program.
+  const shared_ptr<AtomTable> &program_table() const { return program_table_; }
+};
+
+uint8_t VariableDeclarationKindByte(const VariableDeclarationKind &kind) {
+  auto source = kind.GenJs();
+  return source == "var" ? 0 : source == "let" ? 1 : 2;
+}
+
+const VariableDeclarationKind &VariableDeclarationKindFromByte(uint8_t byte) {
+  return byte == 0   ? VariableDeclarationKind::kVar
+         : byte == 1 ? VariableDeclarationKind::kLet
+                     : VariableDeclarationKind::kConst;
+}
+
+uint8_t ImportKindByte(const ImportKind &kind) {
+  auto source = kind.GenJs();
+  return source == "value"    ? 0
+         : source == "type"   ? 1
+         : source == "typeof" ? 2
+                              : 3;
+}
+
+const ImportKind &ImportKindFromByte(uint8_t byte) {
+  return byte == 0   ? ImportKind::kValue
+         : byte == 1 ? ImportKind::kType
+         : byte == 2 ? ImportKind::kTypeOf
+                     : ImportKind::kNull;
+}
+
+// Writes the scalar fields of node and collects its children in stream
+// order.
+void WriteFields(const Node &node, Writer &writer,
+                 vector<const Node *> &children) {
+  auto child = [&](const SN &child) { children.push_back(child.get()); };
+  auto list = [&](const NodeList &list) {
+    writer.Varint(list.size());
+    for (const auto &child : list) {
+      children.push_back(child.get());
+    }
+  };
+  switch (node.type()) {
+  case NodeType::kIdentifier: {
+    auto &identifier = static_cast<const IdentifierNode &>(node);
+    writer.String(identifier.name());
+    break;
+  }
+  case NodeType::kStringLiteral: {
+    auto &literal = static_cast<const StringLiteralNode &>(node);
+    writer.String(literal.value());
+    writer.Byte(literal.quote());
+    break;
+  }
+  case NodeType::kBooleanLiteral: {
+    writer.Byte(static_cast<const BooleanLiteralNode &>(node).value());
+    break;
+  }
+  case NodeType::kNumericLiteral: {
+    auto &literal = static_cast<const NumericLiteralNode &>(node);
+    if (!literal.digits().empty()) {
+      writer.Byte(kBigIntFlag | kDigitsFlag);
+      writer.String(literal.digits());
+      break;
+    }
+    auto integer = IsExactInteger(literal.value());
+    writer.Byte((literal.bigint() ? kBigIntFlag : 0) |
+                (integer ? kIntegerFlag : 0));
+    if (integer) {
+      writer.Varint(static_cast<uint64_t>(literal.value()));
+    } else {
+      writer.Double(literal.value());
+    }
+    break;
+  }
+  case NodeType::kUnaryExpression: {
+    auto &expression = static_cast<const UnaryExpressionNode &>(node);
+    writer.Byte(static_cast<uint8_t>(expression.op().kind()));
+    child(expression.argument());
+    break;
+  }
+  case NodeType::kBinaryExpression: {
+    auto &expression = static_cast<const BinaryExpressionNode &>(node);
+    writer.Byte(static_cast<uint8_t>(expression.op().kind()));
+    child(expression.left());
+    child(expression.right());
+    break;
+  }
+  case NodeType::kExpressionStatement: {
+    child(static_cast<const ExpressionStatementNode &>(node).expression());
+    break;
+  }
+  case NodeType::kBlockStatement: {
+    list(static_cast<const BlockStatementNode &>(node).body());
+    break;
+  }
+  case NodeType::kReturnStatement: {
+    child(static_cast<const ReturnStatementNode &>(node).argument());
+    break;
+  }
+  case NodeType::kIfStatement: {
+    auto &statement = static_cast<const IfStatementNode &>(node);
+    child(statement.test());
+    child(statement.consequent());
+    child(statement.alternate());
+    break;
+  }
+  case NodeType::kSwitchStatement: {
+    auto &statement = static_cast<const SwitchStatementNode &>(node);
+    list(statement.cases());
+    child(statement.discriminant());
+    break;
+  }
+  case NodeType::kSwitchCase: {
+    auto &switch_case = static_cast<const SwitchCaseNode &>(node);
+    list(switch_case.consequent());
+    child(switch_case.test());
+    break;
+  }
+  case NodeType::kWhileStatement: {
+    auto &statement = static_cast<const WhileStatementNode &>(node);
+    child(statement.test());
+    child(statement.body());
+    break;
+  }
+  case NodeType::kDoWhileStatement: {
+    auto &statement = static_cast<const DoWhileStatementNode &>(node);
+    child(statement.test());
+    child(statement.body());
+    break;
+  }
+  case NodeType::kForStatement: {
+    auto &statement = static_cast<const ForStatementNode &>(node);
+    child(statement.init());
+    child(statement.test());
+    child(statement.update());
+    child(statement.body());
+    break;
+  }
+  case NodeType::kVariableDeclaration: {
+    auto &declaration = static_cast<const VariableDeclarationNode &>(node);
+    writer.Byte(VariableDeclarationKindByte(declaration.kind()));
+    list(declaration.declarations());
+    break;
+  }
+  case NodeType::kVariableDeclarator: {
+    auto &declarator = static_cast<const VariableDeclaratorNode &>(node);
+    child(declarator.id());
+    child(declarator.init());
+    break;
+  }
+  case NodeType::kForInStatement: {
+    auto &statement = static_cast<const ForInStatementNode &>(node);
+    child(statement.left());
+    child(statement.right());
+    child(statement.body());
+    break;
+  }
+  case NodeType::kForOfStatement: {
+    auto &statement = static_cast<const ForOfStatementNode &>(node);
+    writer.Byte(statement.await());
+    child(statement.left());
+    child(statement.right());
+    child(statement.body());
+    break;
+  }
+  case NodeType::kThrowStatement: {
+    child(static_cast<const ThrowStatementNode &>(node).argument());
+    break;
+  }
+  case NodeType::kCatchClause: {
+    auto &clause = static_cast<const CatchClauseNode &>(node);
+    child(clause.param());
+    child(clause.body());
+    break;
+  }
+  case NodeType::kTryStatement: {
+    auto &statement = static_cast<const TryStatementNode &>(node);
+    child(statement.block());
+    child(statement.handler());
+    child(statement.finalizer());
+    break;
+  }
+  case NodeType::kFunctionDeclaration: {
+    auto &function = static_cast<const FunctionDeclarationNode &>(node);
+    writer.Byte(function.generator());
+    writer.Byte(function.async());
+    list(function.params());
+    child(function.id());
+    child(function.body());
+    break;
+  }
+  case NodeType::kFunctionExpression: {
+    auto &function = static_cast<const FunctionExpressionNode &>(node);
+    writer.Byte(function.generator());
+    writer.Byte(function.async());
+    list(function.params());
+    child(function.id());
+    child(function.body());
+    break;
+  }
+  case NodeType::kProgram: {
+    auto &program = static_cast<const ProgramNode &>(node);
+    writer.Byte(program.source_type().GenJs() == "script");
+    list(program.body());
+    break;
+  }
+  case NodeType::kImportDeclaration: {
+    auto &declaration = static_cast<const ImportDeclarationNode &>(node);
+    writer.Byte(ImportKindByte(declaration.import_kind()));
+    list(declaration.specifiers());
+    child(declaration.source());
+    break;
+  }
+  case NodeType::kImportSpecifier: {
+    auto &specifier = static_cast<const ImportSpecifierNode &>(node);
+    child(specifier.imported());
+    child(specifier.local());
+    break;
+  }
+  case NodeType::kImportDefaultSpecifier: {
+    child(static_cast<const ImportDefaultSpecifierNode &>(node).local());
+    break;
+  }
+  case NodeType::kImportNamespaceSpecifier: {
+    child(static_cast<const ImportNamespaceSpecifierNode &>(node).local());
+    break;
+  }
+  case NodeType::kExportSpecifier: {
+    auto &specifier = static_cast<const ExportSpecifierNode &>(node);
+    child(specifier.exported());
+    child(specifier.local());
+    break;
+  }
+  case NodeType::kExportDefaultSpecifier: {
+    child(static_cast<const ExportDefaultSpecifierNode &>(node).local());
+    break;
+  }
+  case NodeType::kExportNamespaceSpecifier: {
+    child(static_cast<const ExportNamespaceSpecifierNode &>(node).local());
+    break;
+  }
+  case NodeType::kExportNamedDeclaration: {
+    auto &declaration = static_cast<const ExportNamedDeclarationNode &>(node);
+    list(declaration.specifiers());
+    child(declaration.declaration());
+    child(declaration.source());
+    break;
+  }
+  case NodeType::kExportDefaultDeclaration: {
+    child(static_cast<const ExportDefaultDeclarationNode &>(node)
+              .declaration());
+    break;
+  }
+  case NodeType::kExportAllDeclaration: {
+    child(static_cast<const ExportAllDeclarationNode &>(node).source());
+    break;
+  }
+  case NodeType::kCallExpression: {
+    auto &expression = static_cast<const CallExpressionNode &>(node);
+    list(expression.arguments());
+    child(expression.callee());
+    break;
+  }
+  case NodeType::kParenthesizedExpression: {
+    child(static_cast<const ParenthesizedExpressionNode &>(node).expression());
+    break;
+  }
+  default:
+    break;
+  }
+}
+
+// A node whose children are still being decoded.
+struct PendingNode {
+  NodeType type;
+  uint32_t start;
+  // Operator kind, enum kind, quote character or boolean fields.
+  uint8_t flags[2];
+  double number;
+  string_view text;
+  Atom atom;
+  // Index of its first child in the value stack.
+  size_t base;
+  size_t children;
+};
+
+// Number of children of type that are not in its child list.
+size_t FixedChildren(NodeType type) {
+  switch (type) {
+  case NodeType::kUnaryExpression:
+  case NodeType::kExpressionStatement:
+  case NodeType::kReturnStatement:
+  case NodeType::kSwitchStatement:
+  case NodeType::kSwitchCase:
+  case NodeType::kThrowStatement:
+  case NodeType::kImportDeclaration:
+  case NodeType::kImportDefaultSpecifier:
+  case NodeType::kImportNamespaceSpecifier:
+  case NodeType::kExportDefaultSpecifier:
+  case NodeType::kExportNamespaceSpecifier:
+  case NodeType::kExportDefaultDeclaration:
+  case NodeType::kExportAllDeclaration:
+  case NodeType::kCallExpression:
+  case NodeType::kParenthesizedExpression:
+    return 1;
+  case NodeType::kBinaryExpression:
+  case NodeType::kWhileStatement:
+  case NodeType::kDoWhileStatement:
+  case NodeType::kVariableDeclarator:
+  case NodeType::kCatchClause:
+  case NodeType::kFunctionDeclaration:
+  case NodeType::kFunctionExpression:
+  case NodeType::kImportSpecifier:
+  case NodeType::kExportSpecifier:
+  case NodeType::kExportNamedDeclaration:
+    return 2;
+  case NodeType::kIfStatement:
+  case NodeType::kForInStatement:
+  case NodeType::kForOfStatement:
+  case NodeType::kTryStatement:
+    return 3;
+  case NodeType::kForStatement:
+    return 4;
+  default:
+    return 0;
+  }
+}
+
+// Bit i is set if the i-th child after the child list may be missing,
+// as the alternate of an if statement may. Every other child, and every
+// child in a list, must be present, since GenJs and Visitor follow them.
+uint32_t OptionalChildren(NodeType type) {
+  switch (type) {
+  case NodeType::kReturnStatement:
+  case NodeType::kSwitchCase:
+  case NodeType::kFunctionExpression:
+    return 0b1;
+  case NodeType::kVariableDeclarator:
+    return 0b10;
+  case NodeType::kIfStatement:
+    return 0b100;
+  case NodeType::kTryStatement:
+    return 0b110;
+  case NodeType::kForStatement:
+    return 0b111;
+  case NodeType::kExportNamedDeclaration:
+    return 0b11;
+  default:
+    return 0;
+  }
+}
+
+// Whether children has a node wherever node requires one.
+bool HasRequiredChildren(const PendingNode &node, const SN *children) {
+  auto fixed = FixedChildren(node.type);
+  auto list = node.children - fixed;
+  auto optional = OptionalChildren(node.type);
+  for (size_t i = 0; i < node.children; i++) {
+    if (!children[i] && (i < list || !(optional & (1u << (i - list))))) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// Reads what WriteFields wrote, counting the children to expect.
+void ReadFields(PendingNode &node, Reader &reader) {
+  node.children = FixedChildren(node.type);
+  switch (node.type) {
+  case NodeType::kIdentifier:
+    node.atom = reader.ReadAtom();
+    break;
+  case NodeType::kStringLiteral:
+    node.text = reader.String();
+    node.flags[0] = reader.Byte();
+    break;
+  case NodeType::kNumericLiteral:
+    node.flags[0] = reader.Byte();
+    if (node.flags[0] & kDigitsFlag) {
+      node.text = reader.String();
+      node.number = ParseNumber(node.text).value;
+      break;
+    }
+    node.number = node.flags[0] & kIntegerFlag
+                      ? static_cast<double>(reader.Varint())
+                      : reader.Double();
+    break;
+  case NodeType::kBooleanLiteral:
+  case NodeType::kUnaryExpression:
+  case NodeType::kBinaryExpression:
+  case NodeType::kForOfStatement:
+    node.flags[0] = reader.Byte();
+    break;
+  case NodeType::kFunctionDeclaration:
+  case NodeType::kFunctionExpression:
+    node.flags[0] = reader.Byte();
+    node.flags[1] = reader.Byte();
+    node.children += reader.Count();
+    break;
+  case NodeType::kVariableDeclaration:
+  case NodeType::kProgram:
+  case NodeType::kImportDeclaration:
+    node.flags[0] = reader.Byte();
+    node.children += reader.Count();
+    break;
+  case NodeType::kBlockStatement:
+  case NodeType::kSwitchStatement:
+  case NodeType::kSwitchCase:
+  case NodeType::kExportNamedDeclaration:
+  case NodeType::kCallExpression:
+    node.children += reader.Count();
+    break;
+  default:
+    break;
+  }
+}
+
+NodeList ListOf(SN *begin, SN *end) {
+  NodeList list;
+  list.reserve(end - begin);
+  for (auto child = begin; child != end; child++) {
+    list.push_back(move(*child));
+  }
+  return list;
+}
+
+// Builds node from its fields and its children in stream order. Returns
+// nullptr for an operator kind or quote character out of range.
+SN Build(const PendingNode &node, SN *children, AtomTable *table,
+        const shared_ptr<AtomTable> &atoms) {
+  auto end = children + node.children;
+  switch (node.type) {
+  case NodeType::kIdentifier:
+    return make_shared<IdentifierNode>(node.atom, table);
+  case NodeType::kNullLiteral:
+    return make_shared<NullLiteralNode>();
+  case NodeType::kStringLiteral:
+    if (node.flags[0] != '"' && node.flags[0] != '\'') {
+      return nullptr;
+    }
+    return make_shared<StringLiteralNode>(string(node.text),
+                                           static_cast<char>(node.flags[0]));
+  case NodeType::kBooleanLiteral:
+    return make_shared<BooleanLiteralNode>(node.flags[0] != 0);
+  case NodeType::kNumericLiteral:
+    if (node.flags[0] & kDigitsFlag) {
+      return make_shared<NumericLiteralNode>(node.number, string(node.text));
+    }
+    return make_shared<NumericLiteralNode>(node.number,
+                                            node.flags[0] & kBigIntFlag);
+  case NodeType::kUnaryExpression:
+    if (node.flags[0] >= size(kUnaryOperatorSources)) {
+      return nullptr;
+    }
+    return make_shared<UnaryExpressionNode>(
+        UnaryOperator(static_cast<UnaryOperatorKind>(node.flags[0])),
+        move(children[0]));
+  case NodeType::kBinaryExpression:
+    if (node.flags[0] >= size(kBinaryOperatorSources)) {
+      return nullptr;
+    }
+    return make_shared<BinaryExpressionNode>(
+        BinaryOperator(static_cast<BinaryOperatorKind>(node.flags[0])),
+        move(children[0]), move(children[1]));
+  case NodeType::kExpressionStatement:
+    return make_shared<ExpressionStatementNode>(move(children[0]));
+  case NodeType::kBlockStatement:
+    return make_shared<BlockStatementNode>(ListOf(children, end));
+  case NodeType::kEmptyStatement:
+    return make_shared<EmptyStatementNode>();
+  case NodeType::kDebuggerStatement:
+    return make_shared<DebuggerStatementNode>();
+  case NodeType::kReturnStatement:
+    return make_shared<ReturnStatementNode>(move(children[0]));
+  case NodeType::kContinueStatement:
+    return make_shared<ContinueStatementNode>();
+  case NodeType::kBreakStatement:
+    return make_shared<BreakStatementNode>();
+  case NodeType::kIfStatement:
+    return make_shared<IfStatementNode>(move(children[0]), move(children[1]),
+                                        move(children[2]));
+  case NodeType::kSwitchStatement:
+    return make_shared<SwitchStatementNode>(move(end[-1]),
+                                            ListOf(children, end - 1));
+  case NodeType::kSwitchCase:
+    return make_shared<SwitchCaseNode>(move(end[-1]),
+                                       ListOf(children, end - 1));
+  case NodeType::kWhileStatement:
+    return make_shared<WhileStatementNode>(move(children[0]),
+                                           move(children[1]));
+  case NodeType::kDoWhileStatement:
+    return make_shared<DoWhileStatementNode>(move(children[0]),
+                                             move(children[1]));
+  case NodeType::kForStatement:
+    return make_shared<ForStatementNode>(move(children[0]), move(children[1]),
+                                         move(children[2]), move(children[3]));
+  case NodeType::kVariableDeclaration:
+    return make_shared<VariableDeclarationNode>(
+        VariableDeclarationKindFromByte(node.flags[0]),
+        ListOf(children, end));
+  case NodeType::kVariableDeclarator:
+    return make_shared<VariableDeclaratorNode>(move(children[0]),
+                                               move(children[1]));
+  case NodeType::kForInStatement:
+    return make_shared<ForInStatementNode>(
+        move(children[0]), move(children[1]), move(children[2]));
+  case NodeType::kForOfStatement:
+    return make_shared<ForOfStatementNode>(
+        move(children[0]), move(children[1]), move(children[2]),
+        node.flags[0] != 0);
+  case NodeType::kThrowStatement:
+    return make_shared<ThrowStatementNode>(move(children[0]));
+  case NodeType::kCatchClause:
+    return make_shared<CatchClauseNode>(move(children[0]), move(children[1]));
+  case NodeType::kTryStatement:
+    return make_shared<TryStatementNode>(move(children[0]), move(children[1]),
+                                         move(children[2]));
+  case NodeType::kFunctionDeclaration:
+    return make_shared<FunctionDeclarationNode>(
+        move(end[-2]), ListOf(children, end - 2), move(end[-1]),
+        node.flags[0] != 0, node.flags[1] != 0);
+  case NodeType::kFunctionExpression:
+    return make_shared<FunctionExpressionNode>(
+        move(end[-2]), ListOf(children, end - 2), move(end[-1]),
+        node.flags[0] != 0, node.flags[1] != 0);
+  case NodeType::kProgram:
+    return make_shared<ProgramNode>(node.flags[0] ? SourceType::kScript
+                                                  : SourceType::kModule,
+                                    ListOf(children, end), atoms);
+  case NodeType::kImportDeclaration:
+    return make_shared<ImportDeclarationNode>(
+        ImportKindFromByte(node.flags[0]), ListOf(children, end - 1),
+        move(end[-1]));
+  case NodeType::kImportSpecifier:
+    return make_shared<ImportSpecifierNode>(move(children[0]),
+                                            move(children[1]));
+  case NodeType::kImportDefaultSpecifier:
+    return make_shared<ImportDefaultSpecifierNode>(move(children[0]));
+  case NodeType::kImportNamespaceSpecifier:
+    return make_shared<ImportNamespaceSpecifierNode>(move(children[0]));
+  case NodeType::kExportSpecifier:
+    return make_shared<ExportSpecifierNode>(move(children[0]),
+                                            move(children[1]));
+  case NodeType::kExportDefaultSpecifier:
+    return make_shared<ExportDefaultSpecifierNode>(move(children[0]));
+  case NodeType::kExportNamespaceSpecifier:
+    return make_shared<ExportNamespaceSpecifierNode>(move(children[0]));
+  case NodeType::kExportNamedDeclaration:
+    return make_shared<ExportNamedDeclarationNode>(
+        move(end[-2]), ListOf(children, end - 2), move(end[-1]));
+  case NodeType::kExportDefaultDeclaration:
+    return make_shared<ExportDefaultDeclarationNode>(move(children[0]));
+  case NodeType::kExportAllDeclaration:
+    return make_shared<ExportAllDeclarationNode>(move(children[0]));
+  case NodeType::kCallExpression:
+    return make_shared<CallExpressionNode>(move(end[-1]),
+                                           ListOf(children, end - 1));
+  case NodeType::kParenthesizedExpression:
+    return make_shared<ParenthesizedExpressionNode>(move(children[0]));
+  case NodeType::kError:
+    return make_shared<ErrorNode>();
+  default:
+    return nullptr;
+  }
+}
+
+} // namespace
+
+void SerializeAst(const SN &node, string &out) {
+  string nodes;
+  Writer writer(nodes);
+  uint32_t previous_start = 0;
+  vector<const Node *> stack = {node.get()};
+  vector<const Node *> children;
+  while (!stack.empty()) {
+    auto current = stack.back();
+    stack.pop_back();
+    if (!current) {
+      writer.Byte(kNullNodeByte);
+      continue;
+    }
+    writer.Byte(static_cast<uint8_t>(current->type()));
+    writer.Varint(ZigZag(static_cast<int64_t>(current->start()) -
+                         previous_start));
+    previous_start = current->start();
+    children.clear();
+    WriteFields(*current, writer, children);
+    stack.insert(stack.end(), children.rbegin(), children.rend());
+  }
+
+  out.append(kMagic, sizeof(kMagic));
+  Writer header(out);
+  header.U32(kAstFormatVersion);
+  header.Varint(writer.string_count());
+  out += writer.table();
+  out += nodes;
+}
+
+SN DeserializeAst(string_view data) {
+  if (data.size() < sizeof(kMagic) ||
+      memcmp(data.data(), kMagic, sizeof(kMagic)) != 0) {
+    return nullptr;
+  }
+  Reader reader(data.substr(sizeof(kMagic)));
+  if (reader.U32() != kAstFormatVersion) {
+    return nullptr;
+  }
+  reader.ReadStringTable();
+  if (reader.failed()) {
+    return nullptr;
+  }
+  reader.ChooseTable();
+
+  int64_t previous_start = 0;
+  vector<PendingNode> pending;
+  vector<SN> values;
+  do {
+    auto byte = reader.Byte();
+    if (byte == kNullNodeByte) {
+      values.push_back(nullptr);
+    } else if (byte < static_cast<uint8_t>(NodeType::kNodeTypeCount)) {
+      PendingNode node{};
+      node.type = static_cast<NodeType>(byte);
+      auto delta = UnZigZag(reader.Varint());
+      if (delta < -previous_start || delta > UINT32_MAX - previous_start) {
+        return nullptr;
+      }
+      previous_start += delta;
+      node.start = static_cast<uint32_t>(previous_start);
+      node.base = values.size();
+      ReadFields(node, reader);
+      pending.push_back(node);
+    } else {
+      reader.Fail();
+    }
+    if (reader.failed()) {
+      return nullptr;
+    }
+    while (!pending.empty() &&
+           values.size() - pending.back().base == pending.back().children) {
+      auto &node = pending.back();
+      if (!HasRequiredChildren(node, values.data() + node.base)) {
+        return nullptr;
+      }
+      auto built = Build(node, values.data() + node.base, reader.table(),
+                         reader.program_table());
+      if (!built) {
+        return nullptr;
+      }
+      built->set_start(node.start);
+      values.resize(node.base);
+      values.push_back(move(built));
+      pending.pop_back();
+    }
+  } while (!pending.empty());
+
+  if (!reader.at_end() || values.size() != 1) {
+    return nullptr;
+  }
+  return values[0];
+}
+
+SN DeserializeAstFile(const string &path) {
+  MappedFile file(path);
+  return DeserializeAst(file.data());
+}
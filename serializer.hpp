@@ -0,0 +1,43 @@
+#pragma once
+#include "parser.hpp"
+#include <cstdint>
+#include <string>
+#include <string_view>
+using namespace std;
+
+// Binary encoding of a tree, for storing parsed trees and moving them
+// between processes. After the magic bytes and the version comes a table
+// of every distinct identifier, string literal and BigInt text, then the
+// nodes in preorder, each as its NodeType byte, start offset and scalar
+// fields, then its children. Identifiers, strings and the digits of a
+// parsed BigInt are indices into the table, a string literal is followed
+// by its quote character. Child lists are preceded by their length,
+// missing optional children by kNullNodeByte. Counts, lengths and indices
+// are LEB128 varints, and each start offset is the zigzag varint of its
+// difference from the previous node's, which is nearly always one byte.
+// Lazy function bodies are parsed and written in full.
+//
+// Neither direction recurses, so any tree the parser builds round-trips.
+
+// Version of the encoding, bumped on every change to it.
+inline constexpr uint32_t kAstFormatVersion = 4;
+
+// Written in place of a missing optional child.
+inline constexpr uint8_t kNullNodeByte = 0xff;
+
+// Appends the encoding of the tree rooted at node to out.
+void SerializeAst(const SN &node, string &out);
+
+// Decodes a tree written by SerializeAst. Returns nullptr if data is
+// truncated, of another version or otherwise malformed, since it may come
+// from a file anyone could have written. That includes a missing child
+// the node cannot do without, such as either operand of a binary
+// expression. The tree is built from ordinary nodes holding copies of the
+// strings, so it does not refer to data. A program's identifiers are
+// interned into a table of its own, those of any other root into
+// AtomTable::Global().
+SN DeserializeAst(string_view data);
+
+// DeserializeAst of the file at path, mapped rather than read. The mapping
+// is released before returning.
+SN DeserializeAstFile(const string &path);
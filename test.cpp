@@ -1,10 +1,943 @@
+#include "batch_parser.hpp"
+#include "dependency_scan.hpp"
+#include "parallel_lexer.hpp"
+#include "parse_cache.hpp"
 #include "parser.hpp"
+#include "serializer.hpp"
+#include <cassert>
+#include <cmath>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
 #include <iostream>
 #include <istream>
+#include <iterator>
 #include <memory>
+#include <mutex>
 #include <sstream>
+#include <thread>
+#include <tuple>
+#include <unistd.h>
+#include <vector>
+
+// Not part of the WASM build, build it with one command such as:
+//
+//   g++ -std=c++17 -g -I. test.cpp parser.cpp lexer.cpp scanner.cpp
+//     parallel_lexer.cpp parallel_parser.cpp incremental.cpp serializer.cpp
+//     parse_cache.cpp batch_parser.cpp dependency_scan.cpp scope.cpp
+//     visitor.cpp -lfmt -lpthread -o test && ./test
+//
+// Checks are asserts, so leave NDEBUG undefined.
+
+namespace fs = std::filesystem;
+
+namespace {
+
+const ProgramNode &AsProgram(const SN &node) {
+  assert(node && node->type() == NodeType::kProgram);
+  return static_cast<const ProgramNode &>(*node);
+}
+
+// Marks the string token of `a = 'x y';`, scans past it and rewinds onto it.
+void TestRewindOntoString(bool buffered) {
+  Lexer lexer(string("a = 'x y';"));
+  if (buffered) {
+    lexer.Tokenize();
+  }
+  lexer.GetToken();
+  lexer.GetToken();
+  assert(lexer.GetToken() == TokenType::kStringToken);
+  auto mark = lexer.Mark();
+  assert(lexer.GetToken() == TokenType::kSemiColonToken);
+  lexer.Rewind(mark);
+  assert(lexer.current_token() == TokenType::kStringToken);
+  assert(lexer.token_start() == 4);
+  assert(lexer.view() == "x y");
+  assert(lexer.GetToken() == TokenType::kSemiColonToken);
+}
+
+vector<TokenType> Tokens(const string &source) {
+  Lexer lexer(source);
+  vector<TokenType> tokens;
+  while (lexer.GetToken() != TokenType::kEofToken) {
+    tokens.push_back(lexer.current_token());
+  }
+  return tokens;
+}
+
+// Each punctuator lexes whole, runs of them split at the longest match,
+// and comments are skipped.
+void TestPunctuators() {
+  for (const auto &punctuator : kPunctuators) {
+    Lexer lexer(string(punctuator.text) + " ");
+    assert(lexer.GetToken() == punctuator.token);
+    assert(lexer.view() == punctuator.text);
+  }
+  using T = TokenType;
+  assert(Tokens(">>>==") == vector<T>({T::kGreaterGreaterGreaterEqualToken,
+                                       T::kEqualToken}));
+  assert(Tokens("a===b") == vector<T>({T::kIdentifierToken,
+                                       T::kEqualEqualEqualToken,
+                                       T::kIdentifierToken}));
+  assert(Tokens("a?.5:b") ==
+         vector<T>({T::kIdentifierToken, T::kQuestionToken, T::kNumericToken,
+                    T::kColonToken, T::kIdentifierToken}));
+  assert(Tokens("a?.b ?? c ?\?= d") ==
+         vector<T>({T::kIdentifierToken, T::kQuestionDotToken,
+                    T::kIdentifierToken, T::kQuestionQuestionToken,
+                    T::kIdentifierToken, T::kQuestionQuestionEqualToken,
+                    T::kIdentifierToken}));
+  assert(Tokens("....") == vector<T>({T::kEllipsisToken, T::kDotToken}));
+  assert(Tokens("_a // b\n$c /* d */ / 'e'") ==
+         vector<T>({T::kIdentifierToken, T::kIdentifierToken, T::kDivToken,
+                    T::kStringToken}));
+}
+
+// Chunks cut inside block comments, and strings holding comment markers,
+// still give the sequential token stream.
+void TestParallelTokenize() {
+  string source;
+  while (source.size() < 1 << 20) {
+    source += "a /* 'x\n \"y\n */ + 'b // c' + \"d /* e\";\n"
+              "// f 'g\nh.i(...j) >>>= 0x1f;\n";
+  }
+  Lexer lexer(source);
+  lexer.Tokenize();
+  auto &expected = lexer.tokens();
+  ThreadPool pool(4);
+  for (size_t chunks : {2, 3, 7, 16}) {
+    auto tokens = ParallelTokenize(source, pool, chunks);
+    assert(tokens.size() == expected.size());
+    for (size_t i = 0; i < tokens.size(); i++) {
+      assert(tokens.kind(i) == expected.kind(i));
+      assert(tokens.start(i) == expected.start(i));
+      assert(tokens.length(i) == expected.length(i));
+    }
+  }
+}
+
+// Every keyword maps to its token, and words one letter off stay
+// identifiers.
+void TestKeywords() {
+  const pair<const char *, TokenType> keywords[] = {
+      {"as", TokenType::kAsToken},
+      {"async", TokenType::kAsyncToken},
+      {"await", TokenType::kAwaitToken},
+      {"break", TokenType::kBreakToken},
+      {"case", TokenType::kCaseToken},
+      {"catch", TokenType::kCatchToken},
+      {"class", TokenType::kClassToken},
+      {"const", TokenType::kConstToken},
+      {"continue", TokenType::kContinueToken},
+      {"debugger", TokenType::kDebuggerToken},
+      {"default", TokenType::kDefaultToken},
+      {"delete", TokenType::kDeleteToken},
+      {"do", TokenType::kDoToken},
+      {"else", TokenType::kElseToken},
+      {"enum", TokenType::kEnumToken},
+      {"export", TokenType::kExportToken},
+      {"extends", TokenType::kExtendsToken},
+      {"false", TokenType::kBooleanToken},
+      {"finally", TokenType::kFinallyToken},
+      {"for", TokenType::kForToken},
+      {"from", TokenType::kFromToken},
+      {"function", TokenType::kFunctionToken},
+      {"if", TokenType::kIfToken},
+      {"import", TokenType::kImportToken},
+      {"in", TokenType::kInToken},
+      {"instanceof", TokenType::kInstanceOfToken},
+      {"let", TokenType::kLetToken},
+      {"new", TokenType::kNewToken},
+      {"null", TokenType::kNullToken},
+      {"of", TokenType::kOfToken},
+      {"return", TokenType::kReturnToken},
+      {"super", TokenType::kSuperToken},
+      {"switch", TokenType::kSwitchToken},
+      {"this", TokenType::kThisToken},
+      {"throw", TokenType::kThrowToken},
+      {"true", TokenType::kBooleanToken},
+      {"try", TokenType::kTryToken},
+      {"typeof", TokenType::kTypeOfToken},
+      {"var", TokenType::kVarToken},
+      {"void", TokenType::kVoidToken},
+      {"while", TokenType::kWhileToken},
+      {"with", TokenType::kWithToken},
+      {"yield", TokenType::kYieldToken},
+  };
+  for (const auto &[word, token] : keywords) {
+    assert(LookupKeyword(word) == token);
+    Lexer lexer(string(word) + " x");
+    assert(lexer.GetToken() == token);
+    assert(lexer.view() == word);
+    string longer = string(word) + "s";
+    assert(LookupKeyword(longer) == TokenType::kIdentifierToken);
+    string changed = word;
+    changed.back() = changed.back() == 'z' ? 'y' : 'z';
+    assert(LookupKeyword(changed) == TokenType::kIdentifierToken);
+  }
+  for (const char *word : {"", "a", "static", "public", "undefined", "Let",
+                           "$if", "_do", "instanceOf"}) {
+    assert(LookupKeyword(word) == TokenType::kIdentifierToken);
+  }
+}
+
+// A non-name where a binding name goes is reported and skipped, and the
+// statements after it still parse.
+void TestExpectedIdentifier() {
+  for (const char *source : {"let = ;", "let 1 = 2;"}) {
+    ParserOptions options;
+    options.scopes = true;
+    Parser parser(string(source) + " let b = c;", options);
+    auto tree = parser.Parse();
+    auto &program = AsProgram(tree);
+    assert(parser.diagnostics().size() == 1);
+    assert(parser.diagnostics()[0].offset == 4);
+    assert(parser.diagnostics()[0].message == "Expected identifier");
+    assert(program.body().size() == 2);
+    assert(program.body()[0]->type() == NodeType::kError);
+    assert(program.body()[1]->GenJs() == "let b = c");
+    assert(parser.scopes()->bindings.size() == 1);
+    assert(parser.atoms()->name(parser.scopes()->bindings[0].name) == "b");
+  }
+}
+
+// Lists of names stop at the first bad one instead of spinning on it.
+void TestBadNameInList() {
+  Parser parser("f(1); function g(a, 2) {} h(b);");
+  auto tree = parser.Parse();
+  auto &program = AsProgram(tree);
+  assert(parser.diagnostics().size() == 2);
+  assert(parser.diagnostics()[0].offset == 2);
+  assert(parser.diagnostics()[1].offset == 20);
+  assert(program.body().size() == 3);
+  assert(program.body()[2]->GenJs() == "h(b)");
+}
+
+void TestModuleSpecifierNames() {
+  Parser parser("export { a as default }; export * from 'm';"
+                "export { b } from \"n\"; import { default as c } from 'o';");
+  auto tree = parser.Parse();
+  auto &program = AsProgram(tree);
+  assert(parser.diagnostics().empty());
+  assert(program.body()[1]->GenJs() == "export * from 'm'");
+  auto &reexport =
+      static_cast<const ExportNamedDeclarationNode &>(*program.body()[2]);
+  assert(reexport.source()->type() == NodeType::kStringLiteral);
+  assert(program.body()[3]->GenJs() == "import { default as c } from 'o'");
+}
+
+const NumericLiteralNode &ParseLiteral(const string &source) {
+  static SN tree;
+  Parser parser(source + ";");
+  tree = parser.Parse();
+  assert(parser.diagnostics().empty());
+  auto &statement = static_cast<const ExpressionStatementNode &>(
+      *AsProgram(tree).body()[0]);
+  assert(statement.expression()->type() == NodeType::kNumericLiteral);
+  return static_cast<const NumericLiteralNode &>(*statement.expression());
+}
+
+// Every literal form is read to the nearest double, and BigInts keep
+// their digits.
+void TestNumericLiterals() {
+  assert(ParseLiteral("1_000").value() == 1000);
+  assert(ParseLiteral("1.5e3").value() == 1500);
+  assert(ParseLiteral(".25").value() == 0.25);
+  assert(ParseLiteral("0x1F").value() == 31);
+  assert(ParseLiteral("0o17").value() == 15);
+  assert(ParseLiteral("0b1_01").value() == 5);
+  assert(ParseLiteral("017").value() == 15);
+  assert(ParseLiteral("019").value() == 19);
+  assert(ParseLiteral("123456789012345678901").value() ==
+         123456789012345678901.0);
+  // Past 2^53 hex, octal and binary round to nearest, ties to even,
+  // including past 2^64 where a dropped digit breaks the tie.
+  assert(ParseLiteral("0x1fffffffffffff1").value() == 0x1fffffffffffff0p0);
+  assert(ParseLiteral("0x20000000000001").value() == 0x20000000000000p0);
+  assert(ParseLiteral("0x20000000000003").value() == 0x20000000000004p0);
+  assert(ParseLiteral("0x20000000000001_00000").value() ==
+         0x20000000000000p20);
+  assert(ParseLiteral("0x20000000000001_00001").value() ==
+         0x20000000000002p20);
+  assert(ParseLiteral("0b1" + string(53, '0') + "1").value() == 0x1p54);
+  assert(ParseLiteral("0o1" + string(400, '0')).value() == HUGE_VAL);
+
+  auto &bigint = ParseLiteral("123456789012345678901234567890n");
+  assert(bigint.bigint());
+  assert(bigint.digits() == "123456789012345678901234567890");
+  assert(bigint.GenJs() == "123456789012345678901234567890n");
+  assert(ParseLiteral("0x1fffffffffffff1n").GenJs() == "0x1fffffffffffff1n");
+  assert(NumericLiteralNode(5, true).GenJs() == "5n");
+}
+
+// Arena mode builds the same trees, long child lists included, and they
+// outlive the parser and each other.
+void TestArenaTrees() {
+  string source = "function f(a, b, c, d, e, f) { g(a, b, c, d, e, f); }"
+                  "let h = 1, i = 2, j = 3, k = 4, l = 5;";
+  ParserOptions options;
+  options.arena = true;
+  SN tree;
+  vector<SN> statements;
+  shared_ptr<AtomTable> statement_atoms;
+  {
+    Parser parser(source, options);
+    tree = parser.Parse();
+    assert(parser.arena()->allocations() > 0);
+    parser.Reset(source, options);
+    parser.ParseStreaming([&](SN statement) {
+      statements.push_back(move(statement));
+    });
+    statement_atoms = parser.atoms();
+  }
+  auto expected = Parser(source).Parse();
+  assert(tree->GenJs() == expected->GenJs());
+  assert(statements.size() == 2);
+  // The parser is gone, statement_atoms keeps the names readable.
+  assert(statements[1]->GenJs() == AsProgram(expected).body()[1]->GenJs());
+}
+
+// Every node type the parser builds survives a round trip, and encoding
+// the decoded tree gives the same bytes.
+void TestSerializeRoundTrip() {
+  Parser parser("import a, { b as c } from 'm'; export { c as d };"
+                "export * from \"n\"; let e = -1.5, f;"
+                "function g(h, i) { return (h + i) * 2 ** 3 ** 4; }"
+                "const j = 10n, l = 0x1fffffffffffff1n; ; { throw !k; }");
+  auto program = parser.Parse();
+  assert(parser.diagnostics().empty());
+  string encoded;
+  SerializeAst(program, encoded);
+  auto decoded = DeserializeAst(encoded);
+  assert(decoded);
+  assert(decoded->GenJs() == program->GenJs());
+  string reencoded;
+  SerializeAst(decoded, reencoded);
+  assert(reencoded == encoded);
+  for (size_t size = 0; size < encoded.size(); size++) {
+    assert(!DeserializeAst(string_view(encoded).substr(0, size)));
+  }
+}
+
+// A file may leave out optional children but not required ones.
+void TestDeserializeMissingChild() {
+  auto decode = [](SN node) {
+    NodeList body;
+    body.push_back(move(node));
+    string encoded;
+    SerializeAst(make_shared<ProgramNode>(SourceType::kModule, move(body)),
+                 encoded);
+    return DeserializeAst(encoded);
+  };
+  auto operand = make_shared<IdentifierNode>("a");
+  assert(decode(make_shared<ReturnStatementNode>(nullptr)));
+  assert(!decode(make_shared<ExpressionStatementNode>(nullptr)));
+  assert(!decode(make_shared<ExpressionStatementNode>(
+      make_shared<BinaryExpressionNode>(BinaryOperator::kAddOp, nullptr,
+                                        operand))));
+  assert(!decode(nullptr));
+  auto if_statement = decode(make_shared<IfStatementNode>(
+      operand, make_shared<EmptyStatementNode>(), nullptr));
+  assert(if_statement && if_statement->GenJs() == "if (a) ");
+}
+
+// Identifiers hold an atom and the table it is an atom of, so their names
+// read the same from any thread and after the parser is gone.
+void TestIdentifierAtoms() {
+  static_assert(sizeof(IdentifierNode) <= sizeof(Node) + 16);
+  SN first_tree, second_tree;
+  {
+    Parser first("a; b;");
+    first_tree = first.Parse();
+    Parser second("b; a;");
+    second_tree = second.Parse();
+  }
+  auto identifier = [](const SN &tree, size_t index) {
+    auto &statement = static_cast<const ExpressionStatementNode &>(
+        *AsProgram(tree).body()[index]);
+    return static_pointer_cast<IdentifierNode>(statement.expression());
+  };
+  auto a = identifier(first_tree, 0), b = identifier(second_tree, 0);
+  assert(a->table() == AsProgram(first_tree).atoms().get());
+  assert(b->table() == AsProgram(second_tree).atoms().get());
+  assert(a->atom() == b->atom());
+  assert(a->name() == "a" && b->name() == "b");
+  string from_thread;
+  thread([&] { from_thread = second_tree->GenJs(); }).join();
+  assert(first_tree->GenJs() == "a\nb");
+  assert(from_thread == "b\na");
+
+  b->set_name("c");
+  assert(b->name() == "c" && identifier(second_tree, 1)->name() == "a");
+  auto hand_built = make_shared<IdentifierNode>("d");
+  assert(hand_built->table() == &AtomTable::Global());
+  assert(hand_built->name() == "d");
+}
+
+// Lazy bodies of one tree forced on separate threads intern into its
+// table together, and come out as an eager parse would, with or without
+// an arena.
+void TestLazyBodiesOnThreads(bool arena) {
+  string source;
+  for (int i = 0; i < 8; i++) {
+    auto n = to_string(i);
+    source += "function f" + n + "() { return x" + n + " + shared; }"
+              "let g" + n + " = function () { return y" + n + " * shared; };";
+  }
+  ParserOptions options;
+  options.lazy_functions = true;
+  options.arena = arena;
+  Parser lazy(source, options);
+  auto tree = lazy.Parse();
+  auto &program = AsProgram(tree);
+  vector<thread> threads;
+  for (const auto &statement : program.body()) {
+    threads.emplace_back([&statement] {
+      if (statement->type() == NodeType::kFunctionDeclaration) {
+        auto &function =
+            static_cast<const FunctionDeclarationNode &>(*statement);
+        assert(!function.body_parsed());
+        function.body();
+        return;
+      }
+      auto &declaration =
+          static_cast<const VariableDeclarationNode &>(*statement);
+      auto &declarator = static_cast<const VariableDeclaratorNode &>(
+          *declaration.declarations()[0]);
+      auto &function =
+          static_cast<const FunctionExpressionNode &>(*declarator.init());
+      assert(!function.body_parsed());
+      function.body();
+    });
+  }
+  for (auto &thread : threads) {
+    thread.join();
+  }
+  Parser eager(source);
+  assert(tree->GenJs() == eager.Parse()->GenJs());
+}
+
+// Lazy parsing gives the eager tree and diagnostics, whatever the nesting
+// and wherever a function expression sits.
+void TestLazyMatchesEager() {
+  for (const char *source :
+       {"function a(b) { function c() { return b; } return c; }",
+        "let d = function e() { return function () { f; }; };",
+        "let g = async function* i(j) { k; }, h = function () { l; };",
+        "export default function m() { n; }",
+        "function o() { { } let p = 1 + ; } q;",
+        "function r() { s(; } function t() { u; }"}) {
+    Parser eager(source);
+    auto expected = eager.Parse();
+    ParserOptions options;
+    options.lazy_functions = true;
+    Parser lazy(source, options);
+    auto tree = lazy.Parse();
+    assert(tree->GenJs() == expected->GenJs());
+    assert(lazy.diagnostics().size() == eager.diagnostics().size());
+    for (size_t i = 0; i < eager.diagnostics().size(); i++) {
+      assert(lazy.diagnostics()[i].offset == eager.diagnostics()[i].offset);
+    }
+    string lazy_encoded;
+    SerializeAst(tree, lazy_encoded);
+    string eager_encoded;
+    SerializeAst(expected, eager_encoded);
+    assert(lazy_encoded == eager_encoded);
+  }
+}
+
+string Encode(const SN &tree) {
+  string encoded;
+  SerializeAst(tree, encoded);
+  return encoded;
+}
+
+// Reparsing after each edit gives the tree, offsets and diagnostics of a
+// fresh parse of the edited text, and leaves the tree it started from as
+// it was.
+void TestReparse(bool lazy) {
+  ParserOptions options;
+  options.lazy_functions = lazy;
+  string source = "let a = 1; function b(c) { return c + d; } e(f);"
+                  "let g = h; function i() { j; } k;";
+  Parser parser(source, options);
+  auto tree = parser.Parse();
+  const vector<vector<TextEdit>> edit_lists = {
+      {{4, 1, "aa"}},
+      {{0, 0, "x; "}},
+      {{source.size() + 3, 0, " l;"}},
+      {{20, 3, ""}, {0, 11, ""}},
+      {{14, 0, "m("}},
+      {{14, 2, ""}},
+      {{0, 0, ""}},
+  };
+  for (const auto &edits : edit_lists) {
+    auto before = Encode(tree);
+    auto edited = parser.Reparse(tree, edits);
+    assert(edited);
+    assert(Encode(tree) == before);
+    for (const auto &edit : edits) {
+      source.replace(edit.offset, edit.deleted, edit.inserted);
+    }
+    Parser fresh(source, options);
+    auto expected = fresh.Parse();
+    assert(Encode(edited) == Encode(expected));
+    assert(parser.diagnostics().size() == fresh.diagnostics().size());
+    for (size_t i = 0; i < fresh.diagnostics().size(); i++) {
+      assert(parser.diagnostics()[i].offset == fresh.diagnostics()[i].offset);
+    }
+    tree = edited;
+  }
+
+  auto size = source.size();
+  assert(!parser.Reparse(tree, {{size + 1, 0, "x"}}));
+  assert(!parser.Reparse(tree, {{size - 1, 2, ""}}));
+  assert(!parser.Reparse(tree, {{0, 1, ""}, {size - 1, 1, ""}}));
+  assert(!parser.Reparse(AsProgram(tree).body()[0], {}));
+  Parser other(source, options);
+  assert(!parser.Reparse(other.Parse(), {}));
+  auto edited = parser.Reparse(tree, {{size, 0, " n;"}});
+  assert(edited && Encode(edited) == Encode(Parser(source + " n;").Parse()));
+  assert(AsProgram(edited).body()[0] == AsProgram(tree).body()[0]);
+
+  // Statements after an edit are copies whose nodes, lazy bodies included,
+  // sit where the edited text has them. The old ones stay where they were.
+  Parser lines("a;\nfunction b() {\n  return c;\n}\n", options);
+  auto old_tree = lines.Parse();
+  auto moved = lines.Reparse(old_tree, {{0, 0, "x;\ny;\n"}});
+  assert(AsProgram(moved).body().size() == 4);
+  auto function = [](const SN &tree, size_t index) {
+    return static_pointer_cast<FunctionDeclarationNode>(
+        AsProgram(tree).body()[index]);
+  };
+  auto copied = function(moved, 3);
+  assert(copied != function(old_tree, 1));
+  assert(copied->body_parsed() == !lazy);
+  auto id = lines.GetPosition(copied->id()->start());
+  assert(id.line == 4 && id.column == 9);
+  auto &body = static_cast<const BlockStatementNode &>(*copied->body());
+  auto statement = lines.GetPosition(body.body()[0]->start());
+  assert(statement.line == 5 && statement.column == 2);
+  assert(function(old_tree, 1)->id()->start() == 12);
+}
+
+
+// Splitting the program across threads gives the tree and diagnostics of
+// a sequential parse, whether lexing is split too and whether bodies are
+// lazy. The source is long enough for several ranges, and has errors in
+// some of them.
+void TestParallelParse() {
+  string source;
+  for (int i = 0; source.size() < 256 * 1024; i++) {
+    auto n = to_string(i);
+    source += "function f" + n + "(a, b) { let c = a + b; { g(c); } return c; }"
+              "let h" + n + " = function () { return -i" + n + "; };"
+              "export { h" + n + " };";
+    if (i % 1000 == 999) {
+      source += "let = " + n + ";";
+    }
+  }
+  Parser sequential(source);
+  auto expected = Encode(sequential.Parse());
+  assert(sequential.diagnostics().size() > 1);
+  for (size_t lex_threads : {0, 4}) {
+    for (bool lazy : {false, true}) {
+      ParserOptions options;
+      options.parse_threads = 4;
+      options.lex_threads = lex_threads;
+      options.lazy_functions = lazy;
+      Parser parallel(source, options);
+      assert(Encode(parallel.Parse()) == expected);
+      assert(parallel.diagnostics().size() ==
+             sequential.diagnostics().size());
+      for (size_t i = 0; i < sequential.diagnostics().size(); i++) {
+        assert(parallel.diagnostics()[i].offset ==
+               sequential.diagnostics()[i].offset);
+      }
+    }
+  }
+}
+
+
+size_t FileCount(const string &directory) {
+  size_t count = 0;
+  for (const auto &file : fs::directory_iterator(directory)) {
+    count += file.is_regular_file();
+  }
+  return count;
+}
+
+// A source parsed a second time is decoded from its entry, also by a
+// cache opened later on the directory, and decodes to the tree a parse
+// builds. Options that change the tree, syntax errors and a damaged entry
+// each mean a parse. Entries past max_bytes go least recently used first.
+void TestParseCache() {
+  auto directory = (fs::temp_directory_path() /
+                    ("yajp-test-cache-" + to_string(getpid())))
+                       .string();
+  fs::remove_all(directory);
+  string source = "function f(a) { return a + 1; } let b = f(c);";
+  string other = "function g(d) { return d - 2; } let e = g(h);";
+  {
+    ParseCache cache(directory, 1 << 20);
+    auto parsed = Encode(cache.Parse(source));
+    assert(cache.misses() == 1 && cache.hits() == 0);
+    assert(Encode(cache.Parse(source)) == parsed);
+    assert(cache.misses() == 1 && cache.hits() == 1);
+    assert(parsed == Encode(Parser(source).Parse()));
+
+    ParserOptions lazy;
+    lazy.lazy_functions = true;
+    assert(Encode(cache.Parse(source, lazy)) == parsed);
+    assert(cache.hits() == 2);
+    ParserOptions no_recover;
+    no_recover.recover = false;
+    cache.Parse(source, no_recover);
+    assert(cache.misses() == 2);
+    cache.Parse("let = 1;");
+    cache.Parse("let = 1;");
+    assert(cache.misses() == 4 && FileCount(directory) == 2);
+  }
+
+  auto path = directory + "/" + ParseCacheKey(source, ParserOptions()) + ".ast";
+  auto entry_size = fs::file_size(path);
+  {
+    ParseCache reopened(directory, 1 << 20);
+    assert(reopened.size() == 2 * entry_size);
+    reopened.Parse(source);
+    assert(reopened.hits() == 1);
+    {
+      ofstream out(path, ios::binary | ios::trunc);
+      out << "not an entry";
+    }
+    assert(Encode(reopened.Parse(source)) == Encode(Parser(source).Parse()));
+    assert(reopened.misses() == 1);
+  }
+
+  // Room for one entry, which opening keeps the most recent of.
+  ParseCache small(directory, entry_size * 3 / 2);
+  assert(FileCount(directory) == 1 && small.size() == entry_size);
+  small.Parse(source);
+  small.Parse(other);
+  small.Parse(source);
+  assert(small.hits() == 1 && small.misses() == 2);
+  assert(FileCount(directory) == 1);
+  fs::remove_all(directory);
+}
+
+// Reset gives the parse a new parser would and leaves trees of earlier
+// parses readable, reusing the atom table once no tree holds it.
+void TestReset() {
+  Parser parser("let a = b;");
+  auto first = parser.Parse();
+  auto first_table = parser.atoms().get();
+  string source = "c(d); let = 1;";
+  parser.Reset(source);
+  auto second = parser.Parse();
+  assert(parser.atoms().get() != first_table);
+  assert(first->GenJs() == "let a = b");
+  Parser fresh(source);
+  assert(Encode(second) == Encode(fresh.Parse()));
+  assert(parser.diagnostics().size() == 1);
+  assert(parser.diagnostics()[0].offset == fresh.diagnostics()[0].offset);
+
+  auto second_table = parser.atoms().get();
+  second.reset();
+  parser.Reset("e;");
+  assert(parser.atoms().get() == second_table);
+  assert(parser.Parse()->GenJs() == "e");
+  assert(parser.diagnostics().empty());
+}
+
+void AssertSameParse(const ParseResult &result, const string &source) {
+  Parser parser(source);
+  assert(result.program);
+  assert(Encode(result.program) == Encode(parser.Parse()));
+  assert(result.diagnostics.size() == parser.diagnostics().size());
+  for (size_t i = 0; i < result.diagnostics.size(); i++) {
+    assert(result.diagnostics[i].offset == parser.diagnostics()[i].offset);
+  }
+}
+
+// Each input of a batch gets the tree and errors of its own parse, by
+// index, from sources or files, with results as futures or callbacks.
+// The batch's parse_threads is ignored rather than nesting pools.
+void TestBatch() {
+  vector<string> sources;
+  for (int i = 0; i < 64; i++) {
+    auto n = to_string(i);
+    sources.push_back(i % 5 == 0 ? "let = " + n + "; a" + n + ";"
+                                 : "function f" + n + "(a) { return a + " +
+                                       n + "; } f" + n + "(b);");
+  }
+  ParserOptions options;
+  options.lazy_functions = true;
+  options.parse_threads = 4;
+  BatchParser batch(4, options);
+  auto futures = batch.ParseMany(sources);
+  assert(futures.size() == sources.size());
+  for (size_t i = 0; i < futures.size(); i++) {
+    auto result = futures[i].get();
+    assert(result.index == i && result.path.empty());
+    AssertSameParse(result, sources[i]);
+  }
+
+  mutex results_mutex;
+  vector<int> seen(sources.size());
+  batch.ParseMany(sources, [&](ParseResult result) {
+    AssertSameParse(result, sources[result.index]);
+    lock_guard<mutex> lock(results_mutex);
+    seen[result.index]++;
+  });
+  assert(seen == vector<int>(sources.size(), 1));
+
+  auto directory = fs::temp_directory_path() /
+                   ("yajp-test-batch-" + to_string(getpid()));
+  fs::create_directories(directory);
+  vector<string> paths;
+  for (size_t i = 0; i < 3; i++) {
+    paths.push_back((directory / (to_string(i) + ".js")).string());
+    ofstream(paths.back()) << sources[i];
+  }
+  paths.push_back((directory / "missing.js").string());
+  auto files = batch.ParseFiles(paths);
+  for (size_t i = 0; i < 3; i++) {
+    auto result = files[i].get();
+    assert(result.path == paths[i]);
+    AssertSameParse(result, sources[i]);
+  }
+  auto missing = files[3].get();
+  assert(missing.path == paths[3] && !missing.program);
+  fs::remove_all(directory);
+}
+
+
+// Statements passed to ParseStreaming, encoded as they arrive and then
+// dropped, are those of Parse with the same errors and scopes, whatever
+// the options.
+void TestStreaming() {
+  string source = "import a from 'b'; let c = a + 1; function d(e) {"
+                  " return e * c; } let = 2; { let f = d(c); } g(f);";
+  for (int variant = 0; variant < 5; variant++) {
+    ParserOptions options;
+    options.pretokenize = variant == 1;
+    options.arena = variant == 2;
+    options.lazy_functions = variant == 3;
+    options.scopes = variant == 4;
+    Parser whole(source, options);
+    auto tree = whole.Parse();
+    vector<string> expected;
+    for (const auto &statement : AsProgram(tree).body()) {
+      expected.push_back(Encode(statement));
+    }
+    Parser streaming(source, options);
+    vector<string> statements;
+    streaming.ParseStreaming([&](SN statement) {
+      statements.push_back(Encode(statement));
+    });
+    assert(statements == expected);
+    assert(streaming.diagnostics().size() == 1);
+    assert(streaming.diagnostics()[0].offset ==
+           whole.diagnostics()[0].offset);
+    if (options.scopes) {
+      auto &scopes = *streaming.scopes();
+      assert(scopes.scopes.size() == whole.scopes()->scopes.size());
+      assert(scopes.bindings.size() == whole.scopes()->bindings.size());
+      assert(scopes.references.size() ==
+             whole.scopes()->references.size());
+      for (auto &reference : whole.scopes()->references) {
+        assert(scopes.BindingAt(reference.offset) == reference.binding);
+      }
+    }
+  }
+}
+
+
+// Records every declaration form with its names and extent, skips what
+// only looks like one and drops a malformed one without losing the rest.
+void TestDependencyScan() {
+  string source = "import a, { b as c, default as d } from 'm';\n"
+                  "import * as e from \"n\";\n"
+                  "import 'o'\n"
+                  "export { f as g, h };\n"
+                  "export * from 'p';\n"
+                  "export * as q from 'r';\n"
+                  "export default f;\n"
+                  "export function i() { import('s'); x.import; }\n"
+                  "export const j = 1, k = 2;\n"
+                  "{ import.meta; export { t }; }\n"
+                  "import { u v } from 'w'; export { l } from 's'";
+  using S = vector<pair<string, string>>;
+  using K = DependencyKind;
+  const tuple<K, string, S, string> expected[] = {
+      {K::kImport, "m", {{"default", "a"}, {"b", "c"}, {"default", "d"}},
+       "import a, { b as c, default as d } from 'm';"},
+      {K::kImport, "n", {{"*", "e"}}, "import * as e from \"n\";"},
+      {K::kImport, "o", {}, "import 'o'"},
+      {K::kExportNamed, "", {{"g", "f"}, {"h", "h"}},
+       "export { f as g, h };"},
+      {K::kExportAll, "p", {}, "export * from 'p';"},
+      {K::kExportNamed, "r", {{"q", "*"}}, "export * as q from 'r';"},
+      {K::kExportDefault, "", {{"default", ""}}, "export default f;"},
+      {K::kExportNamed, "", {{"i", "i"}},
+       "export function i() { import('s'); x.import; }"},
+      {K::kExportNamed, "", {{"j", "j"}, {"k", "k"}},
+       "export const j = 1, k = 2;"},
+      {K::kExportNamed, "s", {{"l", "l"}}, "export { l } from 's'"},
+  };
+  auto records = ScanDependencies(source);
+  assert(records.size() == size(expected));
+  for (size_t i = 0; i < records.size(); i++) {
+    auto &[kind, module, specifiers, text] = expected[i];
+    assert(records[i].kind == kind);
+    assert(records[i].source == module);
+    assert(records[i].specifiers.size() == specifiers.size());
+    for (size_t j = 0; j < specifiers.size(); j++) {
+      assert(records[i].specifiers[j].name == specifiers[j].first);
+      assert(records[i].specifiers[j].local == specifiers[j].second);
+    }
+    assert(source.substr(records[i].start,
+                         records[i].end - records[i].start) == text);
+  }
+  assert(ScanDependencies("").empty());
+  assert(ScanDependencies("import { a } from").empty());
+}
+
+
+// References resolve to the innermost binding in scope, seeing functions
+// and vars declared further down. A var belongs to its function, as does
+// the name of a function expression. Names nothing declares are globals.
+void TestScopes() {
+  string source = "import a from 'm'; f(a, b);"
+                  "function f(c) { let d = c; { let c = d; g(c); }"
+                  " { var e = c; } return e; }"
+                  "let i = function h() { return h; };";
+  // Offset of the nth occurrence of text.
+  auto at = [&](const string &text, int n) {
+    size_t offset = source.find(text);
+    while (n-- > 0) {
+      offset = source.find(text, offset + 1);
+    }
+    assert(offset != string::npos);
+    return offset;
+  };
+  ParserOptions options;
+  options.scopes = true;
+  Parser parser(source, options);
+  parser.Parse();
+  assert(parser.diagnostics().empty());
+  auto &tree = *parser.scopes();
+  auto declared_at = [&](size_t reference, size_t declaration,
+                         BindingKind kind) {
+    auto binding = tree.BindingAt(reference);
+    assert(binding != kNoBinding);
+    assert(tree.bindings[binding].offset == declaration);
+    assert(tree.bindings[binding].kind == kind);
+    assert(parser.atoms()->name(tree.bindings[binding].name) ==
+           source.substr(reference, 1));
+    return tree.bindings[binding];
+  };
+
+  declared_at(at("f(a", 0), at("f(c", 0), BindingKind::kFunction);
+  declared_at(at("a, b", 0), at("a from", 0), BindingKind::kImport);
+  assert(tree.BindingAt(at("b)", 0)) == kNoBinding);
+  declared_at(at("c; {", 0), at("c)", 0), BindingKind::kParam);
+  declared_at(at("d; g", 0), at("d =", 0), BindingKind::kLet);
+  assert(tree.BindingAt(at("g(", 0)) == kNoBinding);
+  declared_at(at("c); }", 0), at("c = d", 0), BindingKind::kLet);
+  declared_at(at("c; }", 0), at("c)", 0), BindingKind::kParam);
+  auto e = declared_at(at("e;", 0), at("e =", 0), BindingKind::kVar);
+  assert(tree.scopes[e.scope].kind == ScopeKind::kFunction);
+  auto h = declared_at(at("h; }", 0), at("h()", 0), BindingKind::kFunction);
+  assert(tree.scopes[h.scope].kind == ScopeKind::kFunction);
+  assert(tree.scopes[0].kind == ScopeKind::kModule);
+  for (size_t i = 1; i < tree.scopes.size(); i++) {
+    assert(tree.scopes[i].parent < i);
+  }
+}
+
+
+// Every truncation of a program, and every one with a byte deleted,
+// parses to the end without aborting, with errors in source order inside
+// the source. Each broken statement gets an ErrorNode and an error, and
+// the ones around it parse as usual.
+void TestRecovery() {
+  string source = "import { a as b } from 'c'; export default d;"
+                  "function e(f, ...g) { for (let h of g) { f(h); }"
+                  " while (f) { break; } return -f ** 2; }"
+                  "let i = async function* () { yield; }, j = `k${l}`;"
+                  "switch (m) { case 1: n; default: } do o; while (p)";
+  for (size_t size = 0; size <= source.size(); size++) {
+    for (size_t deleted = 0; deleted <= size; deleted++) {
+      auto text = source.substr(0, size);
+      if (deleted < size) {
+        text.erase(deleted, 1);
+      }
+      Parser parser(text);
+      assert(parser.Parse());
+      size_t last = 0;
+      for (const auto &diagnostic : parser.diagnostics()) {
+        assert(diagnostic.offset >= last && diagnostic.offset <= text.size());
+        last = diagnostic.offset;
+      }
+    }
+  }
+
+  Parser parser("let a = ; b; let = c; d(e);");
+  auto tree = parser.Parse();
+  auto &program = AsProgram(tree);
+  assert(parser.diagnostics().size() == 2);
+  assert(parser.diagnostics()[0].offset == 8);
+  assert(parser.diagnostics()[1].offset == 17);
+  assert(program.body().size() == 4);
+  assert(program.body()[0]->type() == NodeType::kError);
+  assert(program.body()[1]->GenJs() == "b");
+  assert(program.body()[2]->type() == NodeType::kError);
+  assert(program.body()[3]->GenJs() == "d(e)");
+
+  // Constructs left open report once at the end, not once each.
+  for (bool lazy : {false, true}) {
+    ParserOptions options;
+    options.lazy_functions = lazy;
+    for (const char *source : {"{ { {", "function f() { { (a"}) {
+      Parser open(source, options);
+      Encode(open.Parse());
+      assert(open.diagnostics().size() == 1);
+      assert(open.diagnostics()[0].offset == strlen(source));
+    }
+  }
+}
+
+} // namespace
 
 int main() {
+  TestRewindOntoString(false);
+  TestRewindOntoString(true);
+  TestPunctuators();
+  TestKeywords();
+  TestParallelTokenize();
+  TestExpectedIdentifier();
+  TestBadNameInList();
+  TestModuleSpecifierNames();
+  TestNumericLiterals();
+  TestArenaTrees();
+  TestSerializeRoundTrip();
+  TestDeserializeMissingChild();
+  TestIdentifierAtoms();
+  TestLazyBodiesOnThreads(false);
+  TestLazyBodiesOnThreads(true);
+  TestLazyMatchesEager();
+  TestReparse(false);
+  TestReparse(true);
+  TestParallelParse();
+  TestParseCache();
+  TestReset();
+  TestBatch();
+  TestStreaming();
+  TestDependencyScan();
+  TestScopes();
+  TestRecovery();
+
   auto parser = new Parser(""
                            "import sayHello from 'hello';"
                            "sayHello();"
@@ -14,4 +947,4 @@ int main() {
                            "}");
   auto program = parser->Parse();
   // cout << program.get()->type() << endl;
-}
\ No newline at end of file
+}
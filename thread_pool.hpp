@@ -0,0 +1,78 @@
+#pragma once
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+using namespace std;
+
+// Fixed set of worker threads draining a shared FIFO. With zero workers,
+// or in a wasm build without pthreads, Submit runs the task inline.
+class ThreadPool {
+  vector<thread> workers_;
+  deque<function<void()>> tasks_;
+  mutex mutex_;
+  condition_variable ready_;
+  bool stopping_ = false;
+
+  void Work() {
+    while (true) {
+      function<void()> task;
+      {
+        unique_lock<mutex> lock(mutex_);
+        ready_.wait(lock, [this] { return stopping_ || !tasks_.empty(); });
+        if (tasks_.empty()) {
+          return;
+        }
+        task = move(tasks_.front());
+        tasks_.pop_front();
+      }
+      task();
+    }
+  }
+
+public:
+  explicit ThreadPool(size_t threads = thread::hardware_concurrency()) {
+#if defined(__EMSCRIPTEN__) && !defined(__EMSCRIPTEN_PTHREADS__)
+    threads = 0;
+#endif
+    for (size_t i = 0; i < threads; i++) {
+      workers_.emplace_back([this] { Work(); });
+    }
+  }
+
+  ThreadPool(const ThreadPool &) = delete;
+  ThreadPool &operator=(const ThreadPool &) = delete;
+
+  ~ThreadPool() {
+    {
+      lock_guard<mutex> lock(mutex_);
+      stopping_ = true;
+    }
+    ready_.notify_all();
+    for (auto &worker : workers_) {
+      worker.join();
+    }
+  }
+
+  template <typename F> auto Submit(F task) -> future<decltype(task())> {
+    auto packaged =
+        make_shared<packaged_task<decltype(task())()>>(move(task));
+    auto result = packaged->get_future();
+    if (workers_.empty()) {
+      (*packaged)();
+      return result;
+    }
+    {
+      lock_guard<mutex> lock(mutex_);
+      tasks_.emplace_back([packaged] { (*packaged)(); });
+    }
+    ready_.notify_one();
+    return result;
+  }
+
+  size_t size() const { return workers_.size(); }
+};
@@ -1,3 +1,4 @@
+#pragma once
 #include <assert.h>
 
 #define UNREACHABLE assert(!"Unreachable code executed!")
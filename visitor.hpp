@@ -46,6 +46,7 @@ class ExportDefaultDeclarationNode;
 class ExportAllDeclarationNode;
 class CallExpressionNode;
 class ParenthesizedExpressionNode;
+class ErrorNode;
 
 #define VISIT(N) \
   virtual void visit##N(shared_ptr<N> node);